@@ -0,0 +1,241 @@
+from __future__ import print_function
+
+import os
+import sys
+import json
+import socket
+import time
+
+if sys.version_info < (2, 7):
+    import unittest2 as unittest
+else:
+    import unittest
+
+from . import session
+from .. import test
+from .. import lib
+from .. import paths
+from ..configuration import IrodsConfig
+
+admins = [('otherrods', 'rods')]
+users  = [('alice', 'rods')]
+
+# The group sizes to measure. Can be overridden with a comma-separated list
+# (e.g. HARD_LINKS_BENCHMARK_GROUP_SIZES=2,10,100).
+group_sizes = [int(n) for n in os.environ.get('HARD_LINKS_BENCHMARK_GROUP_SIZES', '2,10,100,1000,10000').split(',')]
+
+# The file that receives the results of the benchmark run.
+output_file = os.environ.get('HARD_LINKS_BENCHMARK_OUTPUT', os.path.join(paths.irods_directory(), 'log', 'hard_links_benchmark.json'))
+
+# The number of objects used to measure the overhead of the PEPs on data objects
+# that are not hard linked.
+plain_object_count = int(os.environ.get('HARD_LINKS_BENCHMARK_PLAIN_OBJECT_COUNT', '100'))
+
+results = {}
+
+@unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+class Benchmark_Rule_Engine_Plugin_Hard_Links(session.make_sessions_mixin(admins, users), unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        results.clear()
+        results['group_sizes'] = group_sizes
+        results['hostname'] = socket.gethostname()
+        results['timestamp'] = int(time.time())
+
+    @classmethod
+    def tearDownClass(cls):
+        with open(output_file, 'w') as f:
+            json.dump(results, f, indent=4, sort_keys=True)
+
+        print('Benchmark results written to [{0}].'.format(output_file))
+
+    def setUp(self):
+        super(Benchmark_Rule_Engine_Plugin_Hard_Links, self).setUp()
+        self.admin = self.admin_sessions[0]
+
+    def tearDown(self):
+        super(Benchmark_Rule_Engine_Plugin_Hard_Links, self).tearDown()
+
+    def test_link_creation_rate(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            entries = {}
+
+            for size in group_sizes:
+                collection, data_object = self.make_collection_with_data_object('create_{0}'.format(size))
+
+                elapsed = self.time_it(lambda: self.make_hard_link_group(data_object, collection, size))
+                entries[str(size)] = {
+                    'links': size - 1,
+                    'seconds': elapsed,
+                    'links_per_second': (size - 1) / elapsed if elapsed > 0 else None
+                }
+
+                self.admin.assert_icommand(['irm', '-rf', collection])
+
+            results['link_creation'] = entries
+
+    def test_irm_latency(self):
+        self.measure_member_operation('irm', lambda member, _: ['irm', '-f', member])
+
+    def test_itrim_latency(self):
+        resc = 'hl_bench_trim_resc'
+        self.create_resource(resc)
+
+        try:
+            # Each member gets a second replica so that itrim has something to remove.
+            def trim(member, _):
+                self.admin.assert_icommand(['irepl', '-R', resc, member])
+                return ['itrim', '-N1', '-S', resc, member]
+
+            self.measure_member_operation('itrim', trim)
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc])
+
+    def test_imv_latency(self):
+        def rename(member, collection):
+            return ['imv', member, os.path.join(collection, os.path.basename(member) + '.renamed')]
+
+        self.measure_member_operation('imv', rename)
+
+    def test_iphymv_latency(self):
+        config = IrodsConfig()
+
+        resc_0 = 'hl_bench_resc_0'
+        resc_1 = 'hl_bench_resc_1'
+        self.create_resource(resc_0)
+        self.create_resource(resc_1)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                self.enable_hard_links_rule_engine_plugin(config)
+
+                entries = {}
+
+                for size in group_sizes:
+                    collection, data_object = self.make_collection_with_data_object('iphymv_{0}'.format(size), resc_0)
+                    self.make_hard_link_group(data_object, collection, size)
+
+                    elapsed = self.time_it(lambda: self.admin.assert_icommand(['iphymv', '-S', resc_0, '-R', resc_1, data_object]))
+                    entries[str(size)] = {'seconds': elapsed}
+
+                    self.admin.assert_icommand(['irm', '-rf', collection])
+
+                results['iphymv'] = entries
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_0])
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_1])
+
+    def test_pep_overhead_on_objects_without_hard_links(self):
+        config = IrodsConfig()
+
+        def run_operations(label):
+            collection = os.path.join(self.admin.session_collection, 'plain_{0}'.format(label))
+            self.admin.assert_icommand(['imkdir', collection])
+
+            data_objects = [os.path.join(collection, 'foo.{0}'.format(i)) for i in range(plain_object_count)]
+            for path in data_objects:
+                self.admin.assert_icommand(['istream', 'write', path], input='the data')
+
+            timings = {}
+            timings['imv'] = self.time_it(lambda: [self.admin.assert_icommand(['imv', p, p + '.renamed']) for p in data_objects])
+            timings['irm'] = self.time_it(lambda: [self.admin.assert_icommand(['irm', '-f', p + '.renamed']) for p in data_objects])
+
+            self.admin.assert_icommand(['irm', '-rf', collection])
+
+            return timings
+
+        without_plugin = run_operations('without_plugin')
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+            with_plugin = run_operations('with_plugin')
+
+        results['pep_overhead'] = {
+            'objects': plain_object_count,
+            'without_plugin': without_plugin,
+            'with_plugin': with_plugin
+        }
+
+    def measure_member_operation(self, name, make_command):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            entries = {}
+
+            for size in group_sizes:
+                collection, data_object = self.make_collection_with_data_object('{0}_{1}'.format(name, size))
+                links = self.make_hard_link_group(data_object, collection, size)
+
+                # Only the latency of a single operation against a group of the given size matters
+                # here. The remaining members are cleaned up afterwards.
+                command = make_command(links[-1], collection)
+                start = time.time()
+                _, _, ec = self.admin.run_icommand(command)
+                entries[str(size)] = {'seconds': time.time() - start}
+                self.assertEqual(0, ec)
+
+                self.admin.assert_icommand(['irm', '-rf', collection])
+
+            results[name] = entries
+
+    def make_collection_with_data_object(self, name, resource=None):
+        collection = os.path.join(self.admin.session_collection, name)
+        self.admin.assert_icommand(['imkdir', collection])
+
+        data_object = os.path.join(collection, 'foo')
+        file_path = os.path.join(self.admin.local_session_dir, name)
+        lib.make_file(file_path, 1024, 'arbitrary')
+
+        if resource:
+            self.admin.assert_icommand(['iput', '-R', resource, file_path, data_object])
+        else:
+            self.admin.assert_icommand(['iput', file_path, data_object])
+
+        return collection, data_object
+
+    def make_hard_link_group(self, data_object, collection, size):
+        links = []
+
+        for i in range(size - 1):
+            link_name = os.path.join(collection, 'foo.{0}'.format(i))
+            self.make_hard_link(data_object, '0', link_name)
+            links.append(link_name)
+
+        return links
+
+    def time_it(self, fn):
+        start = time.time()
+        fn()
+        return time.time() - start
+
+    def enable_hard_links_rule_engine_plugin(self, config):
+        config.server_config['plugin_configuration']['rule_engines'].insert(0, {
+            'instance_name': 'irods_rule_engine_plugin-hard_links-instance',
+            'plugin_name': 'irods_rule_engine_plugin-hard_links',
+            'plugin_specific_configuration': {}
+        })
+        lib.update_json_file_from_dict(config.server_config_path, config.server_config)
+
+    def make_hard_link(self, logical_path, replica_number, link_name):
+        hard_link_op = json.dumps({
+            'operation': 'hard_links_create',
+            'logical_path': logical_path,
+            'replica_number': replica_number,
+            'link_name': link_name
+        })
+        self.admin.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', hard_link_op, 'null', 'ruleExecOut'])
+
+    def create_resource(self, resource_name):
+        vault_name = resource_name + '_vault'
+        vault_directory = os.path.join(self.admin.local_session_dir, vault_name)
+        if not os.path.exists(vault_directory):
+            os.mkdir(vault_directory)
+        vault = socket.gethostname() + ':' + vault_directory
+        self.admin.assert_icommand(['iadmin', 'mkresc', resource_name, 'unixfilesystem', vault], 'STDOUT', [resource_name])
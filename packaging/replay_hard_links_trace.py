@@ -0,0 +1,245 @@
+#!/usr/bin/python
+from __future__ import print_function
+
+import argparse
+import collections
+import json
+import re
+import struct
+import sys
+
+# Replays the catalog call traces written by the hard links rule engine plugin (see the
+# "trace_directory" option) against an in-memory model of the catalog.
+#
+# GenQuery is not evaluated. Queries are replayed with the row counts that were recorded, and
+# every write (registration, unlink, replica update, metadata) is applied to the model. The
+# result is a deterministic report of the load the plugin put on the catalog and of any hard link
+# group the traced calls left with a single member. Capturing the same workload before and after a
+# change to the plugin and comparing the reports shows the effect of the change.
+
+MAGIC = b'HLTRACE1'
+HEADER = struct.Struct('<BQQqI')
+SEPARATOR = '\x1f'
+
+CALL_KINDS = {
+    1: 'query',
+    2: 'phy_path_reg',
+    3: 'mod_data_obj_meta',
+    4: 'data_obj_unlink',
+    5: 'add_metadata',
+    6: 'remove_metadata',
+    7: 'set_metadata',
+    8: 'server_api_call',
+    9: 'data_obj_phymv',
+    10: 'atomic_metadata',
+    11: 'atomic_acl',
+    12: 'file_stat',
+    13: 'file_chksum'
+}
+
+HARD_LINK_ATTRIBUTE = 'irods::hard_link'
+
+Record = collections.namedtuple('Record', ['kind', 'start', 'duration', 'result', 'arguments', 'agent'])
+
+def read_trace(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    if not data.startswith(MAGIC):
+        raise ValueError('Not a hard links trace file [path={0}]'.format(path))
+
+    offset = len(MAGIC)
+
+    while offset + HEADER.size <= len(data):
+        kind, start, duration, result, length = HEADER.unpack_from(data, offset)
+        offset += HEADER.size
+
+        # The agent may have been killed while writing the final record.
+        if offset + length > len(data):
+            break
+
+        arguments = data[offset:offset + length].decode('utf-8', 'replace')
+        offset += length
+
+        yield Record(CALL_KINDS.get(kind, 'unknown_{0}'.format(kind)), start, duration, result,
+                     arguments.split(SEPARATOR) if arguments else [], path)
+
+def merge_traces(paths):
+    # Records are replayed in start time order. Ties are broken by the order of the files on the
+    # command line so that every run produces the same result.
+    records = [((r.start, i, n), r) for i, p in enumerate(paths) for n, r in enumerate(read_trace(p))]
+    for _, record in sorted(records, key=lambda e: e[0]):
+        yield record
+
+class CatalogModel(object):
+    def __init__(self):
+        # logical path -> {replica number -> {'physical_path': ..., 'resource': ...}}
+        self.data_objects = {}
+        # logical path -> set of (attribute, value, units)
+        self.metadata = collections.defaultdict(set)
+
+    def apply(self, record):
+        if record.result < 0:
+            return
+
+        handler = getattr(self, 'apply_' + record.kind, None)
+        if handler:
+            handler(record.arguments)
+
+    def apply_phy_path_reg(self, args):
+        logical_path, physical_path, resource = args
+        replicas = self.data_objects.setdefault(logical_path, {})
+        replicas[str(len(replicas))] = {'physical_path': physical_path, 'resource': resource}
+
+    def apply_data_obj_unlink(self, args):
+        logical_path, replica_number = args[0], args[1]
+        replicas = self.data_objects.get(logical_path)
+
+        if replicas is None:
+            return
+
+        if replica_number:
+            replicas.pop(replica_number, None)
+
+        if not replica_number or not replicas:
+            self.data_objects.pop(logical_path, None)
+            self.metadata.pop(logical_path, None)
+
+    def apply_server_api_call(self, args):
+        # The plugin only uses the server API to remove data objects.
+        self.apply_data_obj_unlink([args[1], ''])
+
+    def apply_data_obj_phymv(self, args):
+        logical_path, replica_number, _, dst_resource = args
+        replica = self.data_objects.setdefault(logical_path, {}).setdefault(replica_number, {})
+        replica['resource'] = dst_resource
+
+    def apply_mod_data_obj_meta(self, args):
+        logical_path, replica_number = args[0], args[1]
+        columns = dict(a.split('=', 1) for a in args[2:])
+        replica = self.data_objects.setdefault(logical_path, {}).setdefault(replica_number, {})
+
+        if 'filePath' in columns:
+            replica['physical_path'] = columns['filePath']
+        if 'rescName' in columns:
+            replica['resource'] = columns['rescName']
+
+    def apply_add_metadata(self, args):
+        self.metadata[args[0]].add(tuple(args[1:4]))
+
+    def apply_remove_metadata(self, args):
+        self.metadata[args[0]].discard(tuple(args[1:4]))
+
+    def apply_set_metadata(self, args):
+        avus = self.metadata[args[0]]
+        for avu in [a for a in avus if a[0] == args[1]]:
+            avus.discard(avu)
+        avus.add(tuple(args[1:4]))
+
+    def apply_atomic_metadata(self, args):
+        avus = self.metadata[args[0]]
+        for op in json.loads(args[1]):
+            avu = (op['attribute'], op['value'], op.get('units', ''))
+            if op['operation'] == 'add':
+                avus.add(avu)
+            else:
+                avus.discard(avu)
+
+    def hard_link_groups(self):
+        groups = collections.defaultdict(list)
+        for path, avus in self.metadata.items():
+            for attribute, value, units in avus:
+                if attribute == HARD_LINK_ATTRIBUTE:
+                    groups[(value, units)].append(path)
+        return groups
+
+def normalize_query(gql):
+    # Collapses literals so that queries issued once per data object are grouped together.
+    return re.sub(r"'[^']*'", '?', gql)
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+def parse_latency_model(entries):
+    model = {}
+    for entry in entries or []:
+        kind, _, milliseconds = entry.partition('=')
+        if kind not in CALL_KINDS.values() and kind != 'row':
+            raise ValueError('Unknown call kind in latency model [kind={0}]'.format(kind))
+        model[kind] = float(milliseconds)
+    return model
+
+def replay(paths, latency_model, top):
+    model = CatalogModel()
+    calls = collections.defaultdict(lambda: {'count': 0, 'errors': 0, 'rows': 0, 'durations': []})
+    queries = collections.defaultdict(lambda: {'count': 0, 'rows': 0, 'seconds': 0.0})
+    agents = set()
+    simulated_ms = 0.0
+
+    for record in merge_traces(paths):
+        agents.add(record.agent)
+
+        stats = calls[record.kind]
+        stats['count'] += 1
+        stats['durations'].append(record.duration)
+
+        if record.kind == 'query':
+            stats['rows'] += max(record.result, 0)
+            q = queries[normalize_query(record.arguments[0] if record.arguments else '')]
+            q['count'] += 1
+            q['rows'] += max(record.result, 0)
+            q['seconds'] += record.duration / 1e9
+        elif record.result < 0:
+            stats['errors'] += 1
+
+        if record.kind in latency_model:
+            simulated_ms += latency_model[record.kind]
+            if record.kind == 'query':
+                simulated_ms += latency_model.get('row', 0.0) * max(record.result, 0)
+
+        model.apply(record)
+
+    report = {'agents': len(agents), 'calls': {}}
+
+    for kind, stats in sorted(calls.items()):
+        durations = stats.pop('durations')
+        stats['seconds'] = sum(durations) / 1e9
+        stats['p50_ms'] = percentile(durations, 50) / 1e6
+        stats['p99_ms'] = percentile(durations, 99) / 1e6
+        report['calls'][kind] = stats
+
+    report['top_queries'] = [dict(query=gql, **stats) for gql, stats in
+                             sorted(queries.items(), key=lambda e: (-e[1]['count'], e[0]))[:top]]
+
+    if latency_model:
+        report['simulated_seconds'] = simulated_ms / 1000.0
+
+    report['single_member_hard_link_groups'] = [
+        {'uuid': uuid, 'resource_id': resource_id, 'member': members[0]}
+        for (uuid, resource_id), members in sorted(model.hard_link_groups().items()) if len(members) == 1]
+
+    return report
+
+def main():
+    parser = argparse.ArgumentParser(description='Replays catalog call traces written by the hard links rule engine plugin.')
+    parser.add_argument('traces', nargs='+', metavar='TRACE', help='A trace file (e.g. /tmp/traces/12345.trace).')
+    parser.add_argument('--latency', action='append', metavar='KIND=MS',
+                        help='Simulated cost of a call kind in milliseconds (e.g. query=0.5). '
+                             'Use "row" for the cost of each row returned by a query. May be repeated.')
+    parser.add_argument('--top', type=int, default=10, help='The number of most frequent queries to report.')
+    args = parser.parse_args()
+
+    try:
+        report = replay(args.traces, parse_latency_model(args.latency), args.top)
+    except (IOError, ValueError) as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    print(json.dumps(report, indent=4, sort_keys=True))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
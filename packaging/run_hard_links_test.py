@@ -1,5 +1,13 @@
+import optparse
 import subprocess
 
 if __name__ == "__main__":
-    subprocess.call(['sudo', 'python', '-m', 'xmlrunner', 'irods.test.test_rule_engine_plugin_hard_links'])
+    parser = optparse.OptionParser()
+    parser.add_option('--benchmark', action='store_true', default=False,
+                      help='Run the scalability benchmarks instead of the correctness tests.')
+    options, _ = parser.parse_args()
 
+    if options.benchmark:
+        subprocess.call(['sudo', 'python', '-m', 'unittest', 'irods.test.benchmark_rule_engine_plugin_hard_links'])
+    else:
+        subprocess.call(['sudo', 'python', '-m', 'xmlrunner', 'irods.test.test_rule_engine_plugin_hard_links'])
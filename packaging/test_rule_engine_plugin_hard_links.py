@@ -1,10 +1,14 @@
 from __future__ import print_function
 
 import os
+import base64
 import sys
 import shutil
 import json
 import socket
+import subprocess
+import threading
+import time
 
 from time import sleep
 
@@ -581,14 +585,896 @@ class Test_Rule_Engine_Plugin_Hard_Links(session.make_sessions_mixin(admins, use
                     'value: {0}'.format(value)
                 ])
 
-    def enable_hard_links_rule_engine_plugin(self, config):
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_concurrent_hard_link_creation_produces_a_single_hard_link_group(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # Create a new data object.
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+            # Create several hard links to the same replica at the same time.
+            link_names = [os.path.join(self.admin.session_collection, 'foo.{0}'.format(i)) for i in range(8)]
+            error_codes = []
+
+            def make_hard_link(link_name):
+                hard_link_op = json.dumps({
+                    'operation': 'hard_links_create',
+                    'logical_path': data_object,
+                    'replica_number': '0',
+                    'link_name': link_name
+                })
+                _, _, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', hard_link_op, 'null', 'ruleExecOut'])
+                error_codes.append(ec)
+
+            threads = [threading.Thread(target=make_hard_link, args=(link_name,)) for link_name in link_names]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+
+            self.assertEqual([0] * len(link_names), error_codes)
+
+            # Show that every data object belongs to the same hard link group.
+            hl_info = self.get_hard_link_info(data_object)
+            self.assertEqual(1, len(hl_info))
+            self.assertEqual(len(link_names) + 1, self.hard_link_count(hl_info[0]['uuid'], hl_info[0]['resource_id']))
+
+            # Clean up.
+            for path in link_names:
+                self.admin.assert_icommand(['irm', '-f', path], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_storage_usage_is_updated_incrementally(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # Create a new data object.
+            contents = 'the data'
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input=contents)
+            resource_id = self.get_resource_id(data_object)
+            size = len(contents)
+
+            def resource_usage():
+                counters = self.get_hard_links_usage()['resources'].get(resource_id, {})
+                return (counters.get('physical_bytes', 0), counters.get('logical_bytes', 0))
+
+            physical_bytes, logical_bytes = resource_usage()
+
+            # Creating a new hard link group counts the physical object once and both data objects.
+            hard_link_a = os.path.join(self.admin.session_collection, 'foo.0')
+            self.make_hard_link(data_object, '0', hard_link_a)
+            self.assertEqual((physical_bytes + size, logical_bytes + 2 * size), resource_usage())
+
+            # Adding a member only increases the logical bytes.
+            hard_link_b = os.path.join(self.admin.session_collection, 'foo.1')
+            self.make_hard_link(data_object, '0', hard_link_b)
+            self.assertEqual((physical_bytes + size, logical_bytes + 3 * size), resource_usage())
+
+            # Removing a member only decreases the logical bytes.
+            self.admin.assert_icommand(['irm', '-f', hard_link_b], 'STDOUT', ['deprecated'])
+            self.assertEqual((physical_bytes + size, logical_bytes + 2 * size), resource_usage())
+
+            # Dissolving the hard link group restores the original values.
+            self.admin.assert_icommand(['irm', '-f', hard_link_a], 'STDOUT', ['deprecated'])
+            self.assertEqual((physical_bytes, logical_bytes), resource_usage())
+
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_storage_usage_can_be_rebuilt_from_the_hard_link_metadata(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # Create a hard link group.
+            contents = 'the data'
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input=contents)
+            resource_id = self.get_resource_id(data_object)
+            size = len(contents)
+
+            hard_link = os.path.join(self.admin.session_collection, 'foo.0')
+            self.make_hard_link(data_object, '0', hard_link)
+
+            # Rebuilding returns the recomputed totals, which are then returned by hard_links_usage.
+            op = json.dumps({'operation': 'hard_links_usage_rebuild'})
+            utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+            self.assertEqual(0, len(stderr))
+            self.assertEqual(0, ec)
+            rebuilt = json.loads(str(utf8_stdout).strip())
+            self.assertEqual(rebuilt, self.get_hard_links_usage())
+
+            counters = rebuilt['resources'][resource_id]
+            physical_bytes, logical_bytes = counters['physical_bytes'], counters['logical_bytes']
+            self.assertGreaterEqual(physical_bytes, size)
+            self.assertGreaterEqual(logical_bytes, 2 * size)
+
+            # Incremental updates continue from the rebuilt totals.
+            self.admin.assert_icommand(['irm', '-f', hard_link], 'STDOUT', ['deprecated'])
+            counters = self.get_hard_links_usage()['resources'].get(resource_id, {})
+            self.assertEqual((physical_bytes - size, logical_bytes - 2 * size),
+                             (counters.get('physical_bytes', 0), counters.get('logical_bytes', 0)))
+
+            # Only administrators can rebuild the totals.
+            self.user.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'],
+                                      'STDERR', ['CAT_INSUFFICIENT_PRIVILEGE_LEVEL'])
+
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_snapshot_hard_links_every_data_object_in_a_collection_tree(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # Create a collection tree.
+            src_collection = os.path.join(self.admin.session_collection, 'src')
+            sub_collection = os.path.join(src_collection, 'sub')
+            self.admin.assert_icommand(['imkdir', '-p', sub_collection])
+
+            data_objects = [os.path.join(src_collection, 'foo'), os.path.join(sub_collection, 'bar')]
+            for path in data_objects:
+                self.admin.assert_icommand(['istream', 'write', path], input='the data')
+
+            # Take a snapshot of the tree.
+            dst_collection = os.path.join(self.admin.session_collection, 'snapshot')
+            op = json.dumps({
+                'operation': 'hard_links_snapshot',
+                'source_collection': src_collection,
+                'destination_collection': dst_collection
+            })
+            self.admin.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'],
+                                       'STDOUT', ['"data_objects":2'])
+
+            # Show that every data object in the snapshot is hard linked to its source.
+            for path in data_objects:
+                link = dst_collection + path[len(src_collection):]
+                hl_info = self.get_hard_link_info(path)[0]
+                self.admin.assert_icommand(['ils', '-L', link], 'STDOUT', [hl_info['physical_path']])
+                self.admin.assert_icommand(['imeta', 'ls', '-d', link], 'STDOUT', [
+                    'attribute: irods::hard_link',
+                    'value: {0}'.format(hl_info['uuid']),
+                    'units: {0}'.format(hl_info['resource_id'])
+                ])
+
+            # Clean up.
+            self.admin.run_icommand(['irm', '-rf', dst_collection])
+            self.admin.assert_icommand(['irm', '-rf', src_collection])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_interrupted_snapshot_is_resumed_and_reports_skipped_data_objects(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            src_collection = os.path.join(self.admin.session_collection, 'src')
+            self.admin.assert_icommand(['imkdir', src_collection])
+
+            data_objects = [os.path.join(src_collection, name) for name in ['foo', 'bar']]
+            for path in data_objects:
+                self.admin.assert_icommand(['istream', 'write', path], input='the data')
+
+            # A data object without a good replica cannot be linked.
+            stale = os.path.join(src_collection, 'stale')
+            self.admin.assert_icommand(['istream', 'write', stale], input='the data')
+            self.admin.assert_icommand(['iadmin', 'modrepl', 'logical_path', stale, 'replica_number', '0', 'DATA_REPL_STATUS', '0'])
+
+            dst_collection = os.path.join(self.admin.session_collection, 'snapshot')
+            op = json.dumps({
+                'operation': 'hard_links_snapshot',
+                'source_collection': src_collection,
+                'destination_collection': dst_collection
+            })
+
+            def snapshot():
+                utf8_stdout, _, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+                self.assertEqual(0, ec)
+                return json.loads(str(utf8_stdout).strip())
+
+            result = snapshot()
+            self.assertEqual(2, result['data_objects'])
+            self.assertEqual([stale], result['skipped'])
+
+            # The marker is removed once the snapshot is complete, so it cannot be taken again.
+            self.admin.assert_icommand(['imeta', 'ls', '-C', dst_collection], 'STDOUT', ['None'])
+            self.admin.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'],
+                                       'STDERR', ['CAT_NAME_EXISTS_AS_COLLECTION'])
+
+            # Simulate an interruption after the first link was registered but before its metadata was added.
+            link = os.path.join(dst_collection, 'foo')
+            hl_info = self.get_hard_link_info(data_objects[0])[0]
+            self.admin.assert_icommand(['imeta', 'rm', '-d', link, 'irods::hard_link', hl_info['uuid'], hl_info['resource_id']])
+            self.admin.assert_icommand(['imeta', 'add', '-C', dst_collection, 'irods::hard_links::snapshot', src_collection, 'in_progress'])
+
+            # A data object in the way of a link is left untouched and reported.
+            self.admin.assert_icommand(['irm', '-f', os.path.join(dst_collection, 'bar')], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['istream', 'write', os.path.join(dst_collection, 'bar')], input='other data')
+
+            result = snapshot()
+            self.assertEqual(1, result['data_objects'])
+            self.assertEqual(sorted([stale, os.path.join(dst_collection, 'bar')]), sorted(result['skipped']))
+
+            self.admin.assert_icommand(['imeta', 'ls', '-d', link], 'STDOUT', [
+                'attribute: irods::hard_link',
+                'value: {0}'.format(hl_info['uuid']),
+                'units: {0}'.format(hl_info['resource_id'])
+            ])
+            self.admin.assert_icommand(['imeta', 'ls', '-C', dst_collection], 'STDOUT', ['None'])
+
+            # Clean up.
+            self.admin.run_icommand(['irm', '-rf', dst_collection])
+            self.admin.assert_icommand(['iadmin', 'modrepl', 'logical_path', stale, 'replica_number', '0', 'DATA_REPL_STATUS', '1'])
+            self.admin.assert_icommand(['irm', '-rf', src_collection])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_sync_only_links_data_objects_modified_since_the_watermark(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            src_collection = os.path.join(self.admin.session_collection, 'src')
+            dst_collection = os.path.join(self.admin.session_collection, 'dst')
+            self.admin.assert_icommand(['imkdir', src_collection])
+            self.admin.assert_icommand(['imkdir', dst_collection])
+
+            def sync(watermark, remove_orphans=False):
+                op = json.dumps({
+                    'operation': 'hard_links_sync',
+                    'source_collection': src_collection,
+                    'destination_collection': dst_collection,
+                    'watermark': watermark,
+                    'remove_orphans': remove_orphans
+                })
+                utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+                self.assertEqual(0, ec)
+                return json.loads(str(utf8_stdout).strip())
+
+            foo = os.path.join(src_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', foo], input='the data')
+
+            result = sync('0')
+            self.assertEqual(1, result['linked'])
+            self.admin.assert_icommand(['ils', '-L', os.path.join(dst_collection, 'foo')], 'STDOUT', [self.get_physical_path(foo)])
+
+            # Guarantee that the new data object is modified after the watermark.
+            sleep(2)
+            bar = os.path.join(src_collection, 'bar')
+            self.admin.assert_icommand(['istream', 'write', bar], input='more data')
+
+            result = sync(result['watermark'])
+            self.assertEqual(1, result['linked'])
+            self.assertEqual(0, result['relinked'])
+            self.admin.assert_icommand(['ils', '-L', os.path.join(dst_collection, 'bar')], 'STDOUT', [self.get_physical_path(bar)])
+
+            # Give the source data object a third member so that its group survives the removal of
+            # the source. Then remove the source and show that its link is removed as an orphan.
+            other_link = os.path.join(self.admin.session_collection, 'bar.hl')
+            self.make_hard_link(bar, '0', other_link)
+            self.admin.assert_icommand(['irm', '-f', bar], 'STDOUT', ['deprecated'])
+            result = sync(result['watermark'], remove_orphans=True)
+            self.assertEqual(1, result['removed'])
+            self.assertEqual([], result['skipped'])
+            self.admin.assert_icommand(['ils', os.path.join(dst_collection, 'bar')], 'STDERR', ['does not exist'])
+
+            # Removing the source of a group with two members dissolves the group, which leaves a
+            # data object that is not a hard link. It is reported instead of being removed.
+            self.admin.assert_icommand(['irm', '-f', foo], 'STDOUT', ['deprecated'])
+            result = sync(result['watermark'], remove_orphans=True)
+            self.assertEqual(0, result['removed'])
+            self.assertEqual([os.path.join(dst_collection, 'foo')], result['skipped'])
+            self.admin.assert_icommand(['ils', os.path.join(dst_collection, 'foo')], 'STDOUT', ['foo'])
+
+            # Clean up.
+            self.admin.run_icommand(['irm', '-f', other_link])
+            self.admin.run_icommand(['irm', '-rf', dst_collection])
+            self.admin.run_icommand(['irm', '-rf', src_collection])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_recover_rolls_forward_an_interrupted_removal(self):
+        config = IrodsConfig()
+        journal_directory = os.path.join(self.admin.local_session_dir, 'journal')
+        os.mkdir(journal_directory)
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config, {'journal_directory': journal_directory})
+
+            # Simulate an agent that died after unregistering a hard link, but before removing the
+            # hard link metadata from the only remaining member of the hard link group.
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+            resource_id = self.get_resource_id(data_object)
+            uuid = 'd8a9b0c5-3c64-4a68-8d6f-7d1ef0b4a1e9'
+            self.admin.assert_icommand(['imeta', 'add', '-d', data_object, 'irods::hard_link', uuid, resource_id])
+
+            dead_agent = subprocess.Popen(['true'])
+            dead_agent.wait()
+
+            with open(os.path.join(journal_directory, '{0}.0.journal'.format(dead_agent.pid)), 'w') as f:
+                f.write(json.dumps({
+                    'operation': 'remove',
+                    'lock_key': '',
+                    'pid': dead_agent.pid,
+                    'intent': {
+                        'logical_path': os.path.join(self.admin.session_collection, 'bar'),
+                        'uuid': uuid,
+                        'resource_id': resource_id,
+                        'physical_path': self.get_physical_path(data_object)
+                    }
+                }) + '\n')
+                f.write(json.dumps({'step': 'unregistered'}) + '\n')
+
+            op = json.dumps({'operation': 'hard_links_recover'})
+            utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+            self.assertEqual(0, ec)
+            self.assertEqual(1, json.loads(str(utf8_stdout).strip())['rolled_forward'])
+
+            # The hard link group of size one is dissolved and the record is removed.
+            self.admin.assert_icommand(['imeta', 'ls', '-d', data_object], 'STDOUT', ['None'])
+            self.assertEqual([], os.listdir(journal_directory))
+
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_catalog_calls_are_traced_when_enabled(self):
+        config = IrodsConfig()
+        trace_directory = os.path.join(self.admin.local_session_dir, 'traces')
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config, {'trace_directory': trace_directory})
+
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+            hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+            self.make_hard_link(data_object, '0', hard_link)
+
+            # Every agent writes its own trace. The agent that created the hard link must have
+            # recorded the registration of the new data object (call kind 2).
+            traces = [os.path.join(trace_directory, f) for f in os.listdir(trace_directory)]
+            contents = [open(f, 'rb').read() for f in traces]
+            self.assertTrue(all(c.startswith(b'HLTRACE1') for c in contents))
+            self.assertTrue(any(hard_link.encode('utf-8') in c and b'\x02' in c for c in contents))
+
+            self.admin.assert_icommand(['irm', '-f', hard_link], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_migrate_resource_moves_each_physical_object_once(self):
+        config = IrodsConfig()
+
+        resc_0 = 'hl_migrate_resc_0'
+        resc_1 = 'hl_migrate_resc_1'
+        self.create_resource(resc_0)
+        self.create_resource(resc_1)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                self.enable_hard_links_rule_engine_plugin(config)
+
+                # Create a hard link group with three members on the first resource.
+                data_object = os.path.join(self.admin.session_collection, 'foo')
+                self.admin.assert_icommand(['istream', 'write', '-R', resc_0, data_object], input='the data')
+
+                hard_links = [os.path.join(self.admin.session_collection, 'foo.{0}'.format(i)) for i in range(2)]
+                for link in hard_links:
+                    self.make_hard_link(data_object, '0', link)
+
+                op = json.dumps({
+                    'operation': 'hard_links_migrate_resource',
+                    'source_resource': resc_0,
+                    'destination_resource': resc_1
+                })
+                utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+                self.assertEqual(0, ec)
+
+                result = json.loads(str(utf8_stdout).strip())
+                self.assertEqual(1, result['groups'])
+                self.assertEqual(3, result['members'])
+                self.assertEqual(0, result['failed'])
+
+                # Every member references the same physical object on the second resource.
+                members = [data_object] + hard_links
+                physical_path = self.get_physical_path(data_object)
+                for path in members:
+                    self.assertEqual(resc_1, self.get_resource_name(path))
+                    self.assertEqual(physical_path, self.get_physical_path(path))
+                    self.assertEqual(self.get_resource_id(path), self.get_hard_link_info(path)[0]['resource_id'])
+
+                self.admin.assert_icommand(['istream', 'read', hard_links[-1]], 'STDOUT', ['the data'])
+
+                for link in hard_links:
+                    self.admin.run_icommand(['irm', '-f', link])
+                self.admin.assert_icommand(['irm', '-f', data_object])
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_0])
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_1])
+
+    def enable_hard_links_rule_engine_plugin(self, config, plugin_specific_configuration=None):
         config.server_config['plugin_configuration']['rule_engines'].insert(0, {
             'instance_name': 'irods_rule_engine_plugin-hard_links-instance',
             'plugin_name': 'irods_rule_engine_plugin-hard_links',
-            'plugin_specific_configuration': {}
+            'plugin_specific_configuration': plugin_specific_configuration or {}
         })
         lib.update_json_file_from_dict(config.server_config_path, config.server_config)
 
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_hard_links_are_limited_to_the_configured_collections(self):
+        config = IrodsConfig()
+
+        included = os.path.join(self.admin.session_collection, 'linked')
+        excluded = os.path.join(included, 'private')
+        outside = os.path.join(self.admin.session_collection, 'linked_not')
+
+        for collection in [included, excluded, outside]:
+            self.admin.assert_icommand(['imkdir', '-p', collection])
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config, {
+                'include_collections': [included],
+                'exclude_collections': [excluded]
+            })
+
+            data_object = os.path.join(included, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+            # Hard links can only be created inside of the included collection. The name of a
+            # sibling collection sharing the same prefix does not count.
+            for link in [os.path.join(excluded, 'foo.hl'), os.path.join(outside, 'foo.hl')]:
+                hard_link_op = json.dumps({
+                    'operation': 'hard_links_create',
+                    'logical_path': data_object,
+                    'replica_number': '0',
+                    'link_name': link
+                })
+                self.admin.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', hard_link_op, 'null', 'ruleExecOut'], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+                self.admin.assert_icommand(['ils', link], 'STDERR', ['does not exist'])
+
+            hard_link = os.path.join(included, 'foo.hl')
+            self.make_hard_link(data_object, '0', hard_link)
+
+            # Hard linked data objects cannot be moved out of the included collection.
+            self.admin.assert_icommand(['imv', hard_link, os.path.join(outside, 'foo.hl')], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+            self.admin.assert_icommand(['imv', hard_link, os.path.join(included, 'bar')])
+
+            self.admin.assert_icommand(['irm', '-f', os.path.join(included, 'bar')], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['imeta', 'ls', '-d', data_object], 'STDOUT', ['None'])
+            self.admin.assert_icommand(['irm', '-rf', included, outside])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_remove_group_deletes_the_physical_object_once(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+            physical_path = self.get_physical_path(data_object)
+
+            hard_links = [os.path.join(self.admin.session_collection, 'foo.{0}'.format(i)) for i in range(3)]
+            for link in hard_links:
+                self.make_hard_link(data_object, '0', link)
+
+            # The group can be named by any of its members.
+            op = json.dumps({'operation': 'hard_links_remove_group', 'group': hard_links[1]})
+            utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+            self.assertEqual(0, ec)
+
+            result = json.loads(str(utf8_stdout).strip())
+            self.assertEqual(4, result['members'])
+            self.assertEqual(0, result['failed'])
+
+            for path in [data_object] + hard_links:
+                self.admin.assert_icommand(['ils', path], 'STDERR', ['does not exist'])
+
+            self.assertFalse(os.path.exists(physical_path))
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_hard_link_includes_every_replica_when_replica_number_is_all(self):
+        config = IrodsConfig()
+
+        resc = 'hl_all_replicas_resc'
+        self.create_resource(resc)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                self.enable_hard_links_rule_engine_plugin(config)
+
+                data_object = os.path.join(self.admin.session_collection, 'foo')
+                self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+                self.admin.assert_icommand(['irepl', '-R', resc, data_object])
+
+                hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+                self.make_hard_link(data_object, 'all', hard_link)
+
+                # Each replica forms its own hard link group.
+                source_info = self.get_hard_link_info(data_object)
+                link_info = self.get_hard_link_info(hard_link)
+                self.assertEqual(2, len(source_info))
+                self.assertEqual(2, len(link_info))
+                self.assertEqual(sorted(e['uuid'] for e in source_info), sorted(e['uuid'] for e in link_info))
+                self.assertEqual(sorted(e['physical_path'] for e in source_info), sorted(e['physical_path'] for e in link_info))
+
+                self.admin.assert_icommand(['irm', '-f', hard_link], 'STDOUT', ['deprecated'])
+                self.admin.assert_icommand(['imeta', 'ls', '-d', data_object], 'STDOUT', ['None'])
+                self.admin.assert_icommand(['irm', '-f', data_object])
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_hard_link_changes_are_appended_to_the_event_log(self):
+        config = IrodsConfig()
+        event_log_directory = os.path.join(self.admin.local_session_dir, 'events')
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config, {'event_log_directory': event_log_directory})
+
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+            hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+            self.make_hard_link(data_object, '0', hard_link)
+
+            renamed = hard_link + '.renamed'
+            self.admin.assert_icommand(['imv', hard_link, renamed])
+            self.admin.assert_icommand(['irm', '-f', renamed], 'STDOUT', ['deprecated'])
+
+            events = []
+            for segment in sorted(f for f in os.listdir(event_log_directory) if f.endswith('.events')):
+                with open(os.path.join(event_log_directory, segment)) as f:
+                    events.extend(json.loads(line) for line in f)
+
+            self.assertEqual(['group_created', 'member_added', 'member_renamed', 'member_unregistered', 'group_dissolved'],
+                             [e['type'] for e in events])
+
+            # Sequence numbers increase and every event names the same group.
+            sequences = [e['sequence'] for e in events]
+            self.assertEqual(sorted(sequences), sequences)
+            self.assertEqual(len(set(sequences)), len(sequences))
+            self.assertEqual(1, len(set(e['uuid'] for e in events)))
+
+            # Sequence numbers are per host, so every event names the host that wrote it.
+            self.assertEqual(set([socket.gethostname()]), set(e['host'] for e in events))
+
+            self.assertEqual(hard_link, events[1]['logical_path'])
+            self.assertEqual(renamed, events[2]['to'])
+            self.assertEqual(data_object, events[4]['logical_path'])
+
+            self.admin.assert_icommand(['irm', '-f', data_object])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_verify_accepts_an_existing_hard_link_to_the_same_replica(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+            hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+            self.make_hard_link(data_object, '0', hard_link)
+
+            def create(link_name, if_exists):
+                op = json.dumps({
+                    'operation': 'hard_links_create',
+                    'logical_path': data_object,
+                    'replica_number': '0',
+                    'link_name': link_name,
+                    'if_exists': if_exists
+                })
+                return self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+
+            # Without "verify", an existing link is an error.
+            _, stderr, ec = create(hard_link, 'error')
+            self.assertNotEqual(0, ec)
+            self.assertIn('CAT_NAME_EXISTS_AS_DATAOBJ', stderr)
+
+            _, _, ec = create(hard_link, 'verify')
+            self.assertEqual(0, ec)
+
+            # Nothing was changed.
+            link_info = self.get_hard_link_info(hard_link)
+            self.assertEqual(1, len(link_info))
+            self.assertEqual(self.get_hard_link_info(data_object)[0]['uuid'], link_info[0]['uuid'])
+
+            # A data object that is not a hard link to the replica is still rejected.
+            other = os.path.join(self.admin.session_collection, 'bar')
+            self.admin.assert_icommand(['istream', 'write', other], input='other data')
+            _, stderr, ec = create(other, 'verify')
+            self.assertNotEqual(0, ec)
+            self.assertIn('CAT_NAME_EXISTS_AS_DATAOBJ', stderr)
+
+            self.admin.assert_icommand(['irm', '-f', hard_link], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['irm', '-f', data_object, other])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_iphymv_is_rejected_before_copying_when_a_member_cannot_be_updated(self):
+        config = IrodsConfig()
+
+        resc_0 = 'hl_preflight_resc_0'
+        resc_1 = 'hl_preflight_resc_1'
+        self.create_resource(resc_0)
+        self.create_resource(resc_1)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                self.enable_hard_links_rule_engine_plugin(config)
+
+                data_object = os.path.join(self.admin.session_collection, 'foo')
+                self.admin.assert_icommand(['istream', 'write', '-R', resc_0, data_object], input='the data')
+
+                hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+                self.make_hard_link(data_object, '0', hard_link)
+                info = self.get_hard_link_info(hard_link)[0]
+
+                # The link no longer references the group's physical object, so moving the group would split it.
+                self.admin.assert_icommand(['iadmin', 'modrepl', 'logical_path', hard_link, 'replica_number', '0', 'DATA_PATH', '/tmp/elsewhere'])
+
+                self.admin.assert_icommand(['iphymv', '-S', resc_0, '-R', resc_1, data_object], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+
+                # Nothing was moved.
+                self.admin.assert_icommand(['ils', '-l', data_object], 'STDOUT', [resc_0])
+                self.assertEqual(info['resource_id'], self.get_hard_link_info(data_object)[0]['resource_id'])
+
+                self.admin.assert_icommand(['imeta', 'rm', '-d', hard_link, 'irods::hard_link', info['uuid'], info['resource_id']])
+                self.admin.assert_icommand(['imeta', 'rm', '-d', data_object, 'irods::hard_link', info['uuid'], info['resource_id']])
+                self.admin.assert_icommand(['iunreg', hard_link])
+                self.admin.assert_icommand(['irm', '-f', data_object])
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_0])
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_1])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_verify_checks_each_physical_object_once_and_records_the_result_of_the_group(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            data_object = os.path.join(self.admin.session_collection, 'foo')
+            self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+            self.admin.assert_icommand(['ichksum', data_object], 'STDOUT', ['foo'])
+
+            hard_links = [os.path.join(self.admin.session_collection, 'foo.{0}'.format(i)) for i in range(3)]
+            for link in hard_links:
+                self.make_hard_link(data_object, '0', link)
+
+            def verify():
+                op = json.dumps({'operation': 'hard_links_verify', 'verify_checksum': True})
+                utf8_stdout, _, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+                self.assertEqual(0, ec)
+                return json.loads(str(utf8_stdout).strip())
+
+            result = verify()
+            self.assertEqual(1, result['physical_objects'])
+            self.assertEqual(4, result['members'])
+            self.assertEqual({'ok': 4}, result['statuses'])
+
+            # The result of the group is recorded once, on its resource.
+            hl_info = self.get_hard_link_info(data_object)[0]
+            gql = "select META_RESC_ATTR_UNITS where RESC_ID = '{0}' and META_RESC_ATTR_NAME = 'irods::hard_link::verified' and META_RESC_ATTR_VALUE = '{1}'"
+            gql = gql.format(hl_info['resource_id'], hl_info['uuid'])
+            self.admin.assert_icommand(['iquest', '%s', gql], 'STDOUT', ['ok:'])
+
+            # Every member of a group whose physical object is gone is reported.
+            os.remove(self.get_physical_path(data_object))
+            result = verify()
+            self.assertEqual({'missing': 4}, result['statuses'])
+            self.assertEqual(4, len(result['problems']))
+
+            # The previous result is replaced.
+            utf8_stdout, _, ec = self.admin.run_icommand(['iquest', '%s', gql])
+            self.assertEqual(0, ec)
+            self.assertEqual(1, len(str(utf8_stdout).strip().split('\n')))
+            self.assertTrue(str(utf8_stdout).startswith('missing:'))
+
+            for path in hard_links:
+                self.admin.assert_icommand(['irm', '-f', path], 'STDOUT', ['deprecated'])
+            self.admin.assert_icommand(['iunreg', data_object])
+
+    def test_native_rule_language_calls_with_missing_arguments_are_rejected(self):
+        rep = 'irods_rule_engine_plugin-irods_rule_language-instance'
+        self.admin.assert_icommand(['irule', '-r', rep, 'hard_links_usage()', 'null', 'ruleExecOut'], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+        self.admin.assert_icommand(['irule', '-r', rep, 'hard_links_remove_group(*out)', 'null', 'ruleExecOut'], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+        self.admin.assert_icommand(['irule', '-r', rep, 'hard_link_create(*lp)', '*lp=/tempZone/home/rods/foo', 'ruleExecOut'], 'STDERR', ['SYS_INVALID_INPUT_PARAM'])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_snapshot_ignores_sibling_collections_matched_by_like_wildcards(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # "_" matches any character in a LIKE pattern, so "src_1/%" also matches "srcX1/".
+            src_collection = os.path.join(self.admin.session_collection, 'src_1')
+            sibling_collection = os.path.join(self.admin.session_collection, 'srcX1')
+            self.admin.assert_icommand(['imkdir', '-p', os.path.join(src_collection, 'sub'), os.path.join(sibling_collection, 'sub')])
+            self.admin.assert_icommand(['istream', 'write', os.path.join(src_collection, 'sub', 'foo')], input='the data')
+            self.admin.assert_icommand(['istream', 'write', os.path.join(sibling_collection, 'sub', 'bar')], input='the data')
+
+            dst_collection = os.path.join(self.admin.session_collection, 'snapshot')
+            op = json.dumps({
+                'operation': 'hard_links_snapshot',
+                'source_collection': src_collection,
+                'destination_collection': dst_collection
+            })
+            self.admin.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'],
+                                       'STDOUT', ['"data_objects":1'])
+
+            self.admin.assert_icommand(['ils', os.path.join(dst_collection, 'sub', 'foo')], 'STDOUT', ['foo'])
+            self.admin.assert_icommand_fail(['ils', os.path.join(dst_collection, 'sub', 'bar')])
+            self.admin.assert_icommand(['imeta', 'ls', '-d', os.path.join(sibling_collection, 'sub', 'bar')], 'STDOUT', ['None'])
+
+            # Clean up.
+            self.admin.run_icommand(['irm', '-rf', dst_collection])
+            self.admin.assert_icommand(['irm', '-rf', src_collection, sibling_collection])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_verify_with_all_replicas_rejects_a_source_with_a_new_replica(self):
+        config = IrodsConfig()
+
+        other_resc = 'hl_verify_all_resc'
+        self.create_resource(other_resc)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                self.enable_hard_links_rule_engine_plugin(config)
+
+                data_object = os.path.join(self.admin.session_collection, 'foo')
+                self.admin.assert_icommand(['istream', 'write', data_object], input='the data')
+
+                hard_link = os.path.join(self.admin.session_collection, 'foo.hl')
+                self.make_hard_link(data_object, 'all', hard_link)
+
+                def create_all():
+                    op = json.dumps({
+                        'operation': 'hard_links_create',
+                        'logical_path': data_object,
+                        'replica_number': 'all',
+                        'link_name': hard_link,
+                        'if_exists': 'verify'
+                    })
+                    return self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+
+                _, _, ec = create_all()
+                self.assertEqual(0, ec)
+
+                # The new replica is not part of the link, so the link no longer covers "all".
+                self.admin.assert_icommand(['irepl', '-R', other_resc, data_object])
+                _, stderr, ec = create_all()
+                self.assertNotEqual(0, ec)
+                self.assertIn('CAT_NAME_EXISTS_AS_DATAOBJ', stderr)
+
+                self.admin.assert_icommand(['irm', '-f', hard_link], 'STDOUT', ['deprecated'])
+                self.admin.assert_icommand(['irm', '-f', data_object])
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', other_resc])
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_operations_can_be_sent_as_messagepack_or_cbor(self):
+        config = IrodsConfig()
+
+        with lib.file_backed_up(config.server_config_path):
+            self.enable_hard_links_rule_engine_plugin(config)
+
+            # {"operation": "hard_links_usage"}, encoded by hand so that the test does not need
+            # the msgpack or cbor modules.
+            payloads = [
+                'msgpack:' + base64.b64encode(b'\x81\xa9operation\xb0hard_links_usage').decode(),
+                'cbor:' + base64.b64encode(b'\xa1\x69operation\x70hard_links_usage').decode()
+            ]
+
+            expected = self.get_hard_links_usage()
+
+            for payload in payloads:
+                stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', payload, 'null', 'ruleExecOut'])
+                self.assertEqual(0, ec, msg=stderr)
+                self.assertEqual(expected, json.loads(str(stdout).strip()))
+
+                # The payload may also be the content of a rule file.
+                rule_file = os.path.join(self.admin.local_session_dir, 'operation.r')
+                with open(rule_file, 'w') as f:
+                    f.write(payload + '\nINPUT null\nOUTPUT ruleExecOut\n')
+
+                stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', '-F', rule_file])
+                self.assertEqual(0, ec, msg=stderr)
+                self.assertEqual(expected, json.loads(str(stdout).strip()))
+
+            malformed = [
+                # Not base64.
+                'msgpack:not base64!',
+                # Padding in the middle.
+                'msgpack:gq==lv',
+                # A length no encoder produces.
+                'cbor:' + base64.b64encode(b'\xa1\x69operation\x70hard_links_usage').decode().rstrip('=') + 'AAA',
+                # Valid base64 of a truncated document.
+                'msgpack:' + base64.b64encode(b'\x81\xa9operation\xb0hard_links').decode()
+            ]
+
+            for payload in malformed:
+                _, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', payload, 'null', 'ruleExecOut'])
+                self.assertNotEqual(0, ec)
+                self.assertIn('USER_INPUT_FORMAT_ERR', stderr)
+
+    @unittest.skipIf(test.settings.RUN_IN_TOPOLOGY, "Skip for Topology Testing")
+    def test_fanout_limits_apply_to_snapshots_and_group_moves(self):
+        config = IrodsConfig()
+
+        resc_0 = 'hl_fanout_resc_0'
+        resc_1 = 'hl_fanout_resc_1'
+        self.create_resource(resc_0)
+        self.create_resource(resc_1)
+
+        try:
+            with lib.file_backed_up(config.server_config_path):
+                # Every data object after the first needs the only slot, and each agent updates at
+                # most 4 data objects per second.
+                self.enable_hard_links_rule_engine_plugin(config, {
+                    'fanout_chunk_size': 1,
+                    'fanout_slots': 1,
+                    'fanout_rate_limit': 4
+                })
+
+                src_collections = []
+                for i in range(2):
+                    src_collection = os.path.join(self.admin.session_collection, 'src{0}'.format(i))
+                    self.admin.assert_icommand(['imkdir', src_collection])
+                    for j in range(4):
+                        self.admin.assert_icommand(['istream', 'write', '-R', resc_0, os.path.join(src_collection, 'foo{0}'.format(j))], input='the data')
+                    src_collections.append(src_collection)
+
+                # Two snapshots share the slot. Both must finish, and the rate limit spreads each
+                # one over at least (4 - 1) / 4 seconds.
+                results = []
+
+                def take_snapshot(src_collection):
+                    op = json.dumps({
+                        'operation': 'hard_links_snapshot',
+                        'source_collection': src_collection,
+                        'destination_collection': src_collection + '.snapshot'
+                    })
+                    results.append(self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut']))
+
+                start = time.time()
+                threads = [threading.Thread(target=take_snapshot, args=(c,)) for c in src_collections]
+                for t in threads:
+                    t.start()
+                for t in threads:
+                    t.join()
+                self.assertGreaterEqual(time.time() - start, 0.75)
+
+                for stdout, stderr, ec in results:
+                    self.assertEqual(0, ec, msg=stderr)
+                    self.assertIn('"data_objects":4', stdout)
+
+                # Moving a group larger than a chunk reserves the slot before taking the group's lock.
+                data_object = os.path.join(src_collections[0], 'foo0')
+                self.admin.assert_icommand(['iphymv', '-S', resc_0, '-R', resc_1, data_object])
+
+                link = src_collections[0] + '.snapshot/foo0'
+                self.assertEqual(self.get_resource_id(data_object), self.get_hard_link_info(link)[0]['resource_id'])
+                self.admin.assert_icommand(['ils', '-l', link], 'STDOUT', [resc_1])
+
+                for c in src_collections:
+                    self.admin.run_icommand(['irm', '-rf', c + '.snapshot'])
+                    self.admin.assert_icommand(['irm', '-rf', c])
+        finally:
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_0])
+            self.admin.assert_icommand(['iadmin', 'rmresc', resc_1])
+
     def make_hard_link(self, logical_path, replica_number, link_name, session=None):
         hard_link_op = json.dumps({
             'operation': 'hard_links_create',
@@ -599,6 +1485,13 @@ class Test_Rule_Engine_Plugin_Hard_Links(session.make_sessions_mixin(admins, use
         session = self.admin if session == None else session
         session.assert_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', hard_link_op, 'null', 'ruleExecOut'])
 
+    def get_hard_links_usage(self):
+        op = json.dumps({'operation': 'hard_links_usage'})
+        utf8_stdout, stderr, ec = self.admin.run_icommand(['irule', '-r', 'irods_rule_engine_plugin-hard_links-instance', op, 'null', 'ruleExecOut'])
+        self.assertTrue(0 == len(stderr))
+        self.assertTrue(0 == ec)
+        return json.loads(str(utf8_stdout).strip())
+
     def make_perm_string(self, user, permission):
         return user.username + '#' + user.zone_name + ':' + permission
 
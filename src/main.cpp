@@ -19,6 +19,11 @@
 #include <irods/rsPhyPathReg.hpp>
 #include <irods/dataObjTrim.h>
 #include <irods/rsDataObjTrim.hpp>
+#include <irods/rsDataObjPhymv.hpp>
+#include <irods/rsFileStat.hpp>
+#include <irods/rsFileChksum.hpp>
+#include <irods/rs_atomic_apply_metadata_operations.hpp>
+#include <irods/rs_atomic_apply_acl_operations.hpp>
 #include <irods/irods_resource_manager.hpp>
 #include <irods/irods_resource_redirect.hpp>
 #include <irods/scoped_privileged_client.hpp>
@@ -28,8 +33,11 @@
 #include <irods/irods_linked_list_iterator.hpp>
 #include <irods/key_value_proxy.hpp>
 #include <irods/irods_server_api_call.hpp>
+#include <irods/irods_server_properties.hpp>
+#include <irods/irods_configuration_keywords.hpp>
 
 #include "boost/filesystem/path.hpp"
+#include "boost/filesystem/operations.hpp"
 #include "boost/uuid/uuid.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 #include "boost/uuid/uuid_io.hpp"
@@ -43,9 +51,37 @@
 #include <array>
 #include <algorithm>
 #include <iterator>
+#include <limits>
 #include <functional>
 #include <optional>
 #include <chrono>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <signal.h>
+
+// USDT (SystemTap SDT) probes. Each probe is a single nop until a tracer (e.g. bpftrace) attaches
+// to it. Configure with -DIRODS_HARD_LINKS_ENABLE_USDT=OFF to compile them out entirely.
+#ifdef IRODS_HARD_LINKS_ENABLE_USDT
+    #include <sys/sdt.h>
+    #define HARD_LINKS_PROBE(name, ...) STAP_PROBEV(irods_hard_links, name, __VA_ARGS__)
+#else
+    #define HARD_LINKS_PROBE(name, ...)
+#endif
 
 extern irods::resource_manager resc_mgr;
 
@@ -71,314 +107,1418 @@ namespace
         std::string replica_number;
         std::string resource_name;
         std::string resource_id;
+        std::string data_size;
+        std::string owner_name;
+        std::string owner_zone;
     };
 
-    namespace util
+    struct plugin_configuration
     {
-        auto get_rei(irods::callback& effect_handler) -> ruleExecInfo_t&
-        {
-            ruleExecInfo_t* rei{};
-            irods::error result{effect_handler("unsafe_ms_ctx", &rei)};
+        // The directory holding the lock files used to serialize operations on the same
+        // hard link group. All agents on a host must see the same directory.
+        std::string lock_directory = "/tmp/irods_rule_engine_plugin-hard_links";
+
+        // The number of lock files (stripes). Unrelated hard link groups only contend
+        // with each other when they hash to the same stripe.
+        std::size_t lock_stripe_count = 1024;
+
+        // The number of hard link group members fetched from the catalog at a time when a
+        // handler has to visit every member of a group.
+        std::uintmax_t member_page_size = 256;
+
+        // The directory holding the write-ahead records of in-flight operations. Must survive
+        // a restart of the server. Journaling is disabled if empty.
+        std::string journal_directory;
+
+        // Admission control for operations that update many data objects at once. After the
+        // first chunk, an operation requires one of the slots in the lock directory. Setting
+        // "fanout_slots" to 0 disables the slots.
+        // "fanout_rate_limit" caps the data objects an agent processes per second (0 means
+        // unlimited).
+        std::uintmax_t fanout_chunk_size = 64;
+        std::size_t fanout_slots = 4;
+        std::uintmax_t fanout_rate_limit = 0;
+
+        // The directory receiving the catalog call traces written by each agent. Tracing is
+        // disabled if empty.
+        std::string trace_directory;
+
+        // The collections whose data objects may be hard linked. If no collections are included,
+        // every collection is. The deepest listed collection containing a path decides whether
+        // the path is in scope.
+        std::vector<std::string> include_collections;
+        std::vector<std::string> exclude_collections;
+
+        // The directory receiving the log of hard link group changes shared by all agents on the
+        // host, and the size at which a new segment of the log is started. The log is disabled
+        // if the directory is empty.
+        std::string event_log_directory;
+        std::uintmax_t event_log_segment_size = 64 * 1024 * 1024;
+    };
 
-            if (!result.ok()) {
-                THROW(result.code(), "failed to get rule execution info");
-            }
+    plugin_configuration config;
 
-            return *rei;
-        }
+    //
+    // Catalog Call Tracing
+    //
 
-        auto log_exception(const irods::exception& e) -> void
+    namespace trace
+    {
+        // The kinds of calls recorded in a trace. The values are part of the trace format.
+        enum class call_kind : std::uint8_t
         {
-            log::rule_engine::error("{} [error_code={}]", e.what(), e.code());
-        }
+            query             = 1,
+            phy_path_reg      = 2,
+            mod_data_obj_meta = 3,
+            data_obj_unlink   = 4,
+            add_metadata      = 5,
+            remove_metadata   = 6,
+            set_metadata      = 7,
+            server_api_call   = 8,
+            data_obj_phymv    = 9,
+            atomic_metadata   = 10,
+            atomic_acl        = 11,
+            file_stat         = 12,
+            file_chksum       = 13
+        };
 
-        auto make_hard_link_avu(std::string_view uuid, std::string_view resource_id) -> fs::metadata
+        constexpr auto name_of(call_kind kind) noexcept -> const char*
         {
-            return {"irods::hard_link", uuid.data(), resource_id.data()};
+            switch (kind) {
+                case call_kind::query:             return "query";
+                case call_kind::phy_path_reg:      return "phy_path_reg";
+                case call_kind::mod_data_obj_meta: return "mod_data_obj_meta";
+                case call_kind::data_obj_unlink:   return "data_obj_unlink";
+                case call_kind::add_metadata:      return "add_metadata";
+                case call_kind::remove_metadata:   return "remove_metadata";
+                case call_kind::set_metadata:      return "set_metadata";
+                case call_kind::server_api_call:   return "server_api_call";
+                case call_kind::data_obj_phymv:    return "data_obj_phymv";
+                case call_kind::atomic_metadata:   return "atomic_metadata";
+                case call_kind::atomic_acl:        return "atomic_acl";
+                case call_kind::file_stat:         return "file_stat";
+                case call_kind::file_chksum:       return "file_chksum";
+            }
+
+            return "unknown";
         }
 
-        template <typename T>
-        auto get_input_object_ptr(std::list<boost::any>& rule_arguments) -> T*
+        // The arguments of the "catalog__entry" probe. Queries pass the GenQuery string as the path.
+        struct probe_target
         {
-            return boost::any_cast<T*>(*std::next(std::begin(rule_arguments), 2));
-        }
+            const char* path = "";
+            const char* group = "";
+            const char* replica_number = "";
+        };
 
-        auto get_hard_links(rsComm_t& conn, const fs::path& p) -> std::vector<hard_link>
+        // Appends records to "<trace_directory>/<pid>.trace". A new file starts with the magic
+        // string "HLTRACE1", followed by records with this layout (integers are little endian):
+        //
+        //   u8  call kind
+        //   u64 start time in nanoseconds since the Unix epoch
+        //   u64 duration in nanoseconds
+        //   i64 result (the number of rows for queries, the error code otherwise)
+        //   u32 length of the arguments, followed by the arguments
+        //
+        // The arguments of a call are separated by the ASCII unit separator (0x1F). Records are
+        // buffered and written when the buffer fills up or the agent exits.
+        class writer
         {
-            const auto gql = fmt::format("select META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS "
-                                         "where"
-                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
-                                         " COLL_NAME = '{}' and"
-                                         " DATA_NAME = '{}'",
-                                         p.parent_path().c_str(),
-                                         p.object_name().c_str());
+        public:
+            writer() = default;
 
-            std::vector<hard_link> data;
+            ~writer()
+            {
+                flush();
 
-            for (auto&& row : irods::query{&conn, gql}) {
-                data.push_back({row[0], row[1]});
+                if (fd_ != -1) {
+                    close(fd_);
+                }
             }
 
-            return data;
-        }
+            writer(const writer&) = delete;
+            auto operator=(const writer&) -> writer& = delete;
+
+            auto append(call_kind kind,
+                        std::chrono::system_clock::time_point start,
+                        std::chrono::nanoseconds duration,
+                        std::int64_t result,
+                        std::string_view arguments) -> void
+            {
+                using std::chrono::duration_cast;
+                using std::chrono::nanoseconds;
+
+                buffer_.push_back(static_cast<char>(kind));
+                put(static_cast<std::uint64_t>(duration_cast<nanoseconds>(start.time_since_epoch()).count()), 8);
+                put(static_cast<std::uint64_t>(duration.count()), 8);
+                put(static_cast<std::uint64_t>(result), 8);
+                put(arguments.size(), 4);
+                buffer_.append(arguments);
+
+                if (buffer_.size() >= 64 * 1024) {
+                    flush();
+                }
+            }
 
-        auto get_hard_link_members(rsComm_t& conn,
-                                   std::string_view uuid,
-                                   std::string_view resource_id) -> std::vector<fs::path>
-        {
-            const auto gql = fmt::format("select COLL_NAME, DATA_NAME "
-                                         "where"
-                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
-                                         " META_DATA_ATTR_VALUE = '{}' and"
-                                         " META_DATA_ATTR_UNITS = '{}'", uuid, resource_id);
+            auto flush() noexcept -> void
+            {
+                if (buffer_.empty() || !open_file()) {
+                    return;
+                }
+
+                for (std::size_t written = 0; written < buffer_.size();) {
+                    if (const auto n = write(fd_, buffer_.data() + written, buffer_.size() - written); n >= 0) {
+                        written += n;
+                    }
+                    else if (errno != EINTR) {
+                        log::rule_engine::error("Could not write catalog call trace [path={}, errno={}]", path_, errno);
+                        break;
+                    }
+                }
 
-            std::vector<fs::path> members;
+                buffer_.clear();
+            }
 
-            for (auto&& row : irods::query{&conn, gql}) {
-                members.push_back(fs::path{row[0]} / row[1]);
+        private:
+            auto put(std::uint64_t value, int byte_count) -> void
+            {
+                for (int i = 0; i < byte_count; ++i) {
+                    buffer_.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+                }
             }
 
-            return members;
-        }
+            auto open_file() noexcept -> bool
+            {
+                if (fd_ != -1) {
+                    return true;
+                }
 
-        auto get_replicas(rsComm_t& conn, const fs::path& p) -> std::vector<data_object_info>
-        {
-            const auto gql = fmt::format("select DATA_PATH, DATA_REPL_NUM, RESC_NAME, RESC_ID "
-                                         "where COLL_NAME = '{}' and DATA_NAME = '{}'",
-                                         p.parent_path().c_str(),
-                                         p.object_name().c_str());
+                if (mkdir(config.trace_directory.c_str(), S_IRWXU) == -1 && errno != EEXIST) {
+                    log::rule_engine::error("Could not create trace directory [path={}, errno={}]", config.trace_directory, errno);
+                    return false;
+                }
 
-            std::vector<data_object_info> replicas;
+                path_ = fmt::format("{}/{}.trace", config.trace_directory, getpid());
+
+                if (fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR); fd_ == -1) {
+                    log::rule_engine::error("Could not open catalog call trace [path={}, errno={}]", path_, errno);
+                    return false;
+                }
+
+                if (struct stat st{}; fstat(fd_, &st) == 0 && st.st_size == 0) {
+                    buffer_.insert(0, "HLTRACE1");
+                }
 
-            for (auto&& row : irods::query{&conn, gql}) {
-                replicas.push_back({row[0], row[1], row[2], row[3]});
+                return true;
             }
 
-            return replicas;
+            std::string path_;
+            std::string buffer_;
+            int fd_ = -1;
+        }; // class writer
+
+        auto get_writer() -> writer&
+        {
+            static writer w;
+            return w;
         }
 
-        auto register_replica(rsComm_t& conn,
-                              const data_object_info& replica_info,
-                              std::string_view link_name) -> int
+        inline auto enabled() noexcept -> bool
         {
-            dataObjInp_t input{};
-            addKeyVal(&input.condInput, FILE_PATH_KW, replica_info.physical_path.data());
-            addKeyVal(&input.condInput, REPL_NUM_KW, replica_info.replica_number.data());
-            addKeyVal(&input.condInput, DEST_RESC_NAME_KW, replica_info.resource_name.data());
-            rstrcpy(input.objPath, link_name.data(), MAX_NAME_LEN);
+            return !config.trace_directory.empty();
+        }
 
-            // Vanilla iRODS only allows administrators to register data objects.
-            // Elevate privileges so that all users can create hard links.
-            ix::scoped_privileged_client spc{conn};
+        template <typename... Args>
+        auto join(const Args&... args) -> std::string
+        {
+            std::string s;
 
-            const auto ec = rsPhyPathReg(&conn, &input);
+            if (enabled()) {
+                ((s.append(args).push_back('\x1f')), ...);
+                s.pop_back();
+            }
 
-            // Update the parent collection's mtime.
-            if (ec >= 0) {
-                const auto* local_zone = getLocalZoneName();
+            return s;
+        }
 
-                if (const auto zone = fs::zone_name(link_name.data()); zone && *zone == local_zone) {
-                    try {
-                        using std::chrono::system_clock;
-                        using std::chrono::time_point_cast;
+        // Flattens the target and the catalog columns being updated by rsModDataObjMeta.
+        auto serialize(std::string_view logical_path, int replica_number, const keyValPair_t& reg_params) -> std::string
+        {
+            std::string s;
 
-                        const auto now = time_point_cast<fs::object_time_type::duration>(system_clock::now());
+            if (enabled()) {
+                s = join(logical_path, std::to_string(replica_number));
 
-                        fs::server::last_write_time(conn, fs::path{link_name.data()}.parent_path(), now);
-                    }
-                    catch (const fs::filesystem_error& e) {
-                        rodsLog(LOG_ERROR, "Could not update the collection's mtime. [error_code=%d, collection=%s]",
-                                e.code().value(), e.path1().c_str());
-                    }
+                for (int i = 0; i < reg_params.len; ++i) {
+                    s.push_back('\x1f');
+                    s.append(reg_params.keyWord[i]).push_back('=');
+                    s.append(reg_params.value[i]);
                 }
             }
 
-            return ec;
-        };
+            return s;
+        }
 
-        auto unregister_replica(rsComm_t& conn,
-                                const fs::path& logical_path,
-                                const std::optional<std::string_view>& replica_number = std::nullopt) -> int
+        // Times a single call and records it when going out of scope. The call is also bracketed
+        // by the "catalog__entry" and "catalog__return" probes.
+        class scoped_call
         {
-            dataObjInp_t unreg_input{};
-            unreg_input.oprType = UNREG_OPR;
-            rstrcpy(unreg_input.objPath, logical_path.c_str(), MAX_NAME_LEN);
-            addKeyVal(&unreg_input.condInput, FORCE_FLAG_KW, "");
-
-            if (replica_number) {
-                addKeyVal(&unreg_input.condInput, REPL_NUM_KW, replica_number->data());
+        public:
+            scoped_call(call_kind kind, std::string arguments, const probe_target& target = {})
+                : kind_{kind}
+                , arguments_{std::move(arguments)}
+                , start_{std::chrono::system_clock::now()}
+                , started_{std::chrono::steady_clock::now()}
+            {
+                HARD_LINKS_PROBE(catalog__entry, name_of(kind_), target.path, target.group, target.replica_number);
+                static_cast<void>(target);
             }
 
-            // Vanilla iRODS only allows administrators to register data objects.
-            // Elevate privileges so that all users can create hard links.
-            ix::scoped_privileged_client spc{conn};
+            ~scoped_call()
+            {
+                HARD_LINKS_PROBE(catalog__return, name_of(kind_), result_);
 
-            return rsDataObjUnlink(&conn, &unreg_input);
-        }
+                if (!enabled()) {
+                    return;
+                }
 
-        auto unlink_replica(rsComm_t& conn,
-                            const fs::path& logical_path,
-                            const std::optional<std::string_view>& replica_number = std::nullopt) -> int
-        {
-            dataObjInp_t unreg_input{};
-            rstrcpy(unreg_input.objPath, logical_path.c_str(), MAX_NAME_LEN);
-            addKeyVal(&unreg_input.condInput, FORCE_FLAG_KW, "");
+                try {
+                    if (!paused()) {
+                        pause();
+                    }
 
-            if (replica_number) {
-                addKeyVal(&unreg_input.condInput, REPL_NUM_KW, replica_number->data());
+                    get_writer().append(kind_, start_, elapsed_, result_, arguments_);
+                }
+                catch (const std::exception& e) {
+                    log::rule_engine::error("Could not record catalog call [error_message={}]", e.what());
+                }
             }
 
-            return rsDataObjUnlink(&conn, &unreg_input);
-        }
+            scoped_call(const scoped_call&) = delete;
+            auto operator=(const scoped_call&) -> scoped_call& = delete;
 
-        auto set_logical_path(rsComm_t& conn, const fs::path& logical_path, const fs::path& new_logical_path) -> int
-        {
-            dataObjInfo_t info{};
-            rstrcpy(info.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            template <typename T>
+            auto result(T value) noexcept -> T
+            {
+                result_ = static_cast<std::int64_t>(value);
+                return value;
+            }
 
-            keyValPair_t reg_params{};
-            addKeyVal(&reg_params, ALL_KW, "");
+            // Excludes the time since the last call to resume() (or construction) from the duration.
+            auto pause() noexcept -> void
+            {
+                if (!enabled()) {
+                    return;
+                }
 
-            // Update the data name if the names are different.
-            if (const auto object_name = new_logical_path.object_name(); logical_path.object_name() != object_name) {
-                addKeyVal(&reg_params, DATA_NAME_KW, object_name.c_str());
+                elapsed_ += std::chrono::steady_clock::now() - started_;
+                started_ = std::chrono::steady_clock::time_point::max();
             }
 
-            // Update the collection id if the parent paths are different.
-            // (i.e. the data object is moving between collections)
-            if (const auto collection = new_logical_path.parent_path(); logical_path.parent_path() != collection) {
-                if (!fs::server::is_collection(conn, collection)) {
-                    log::rule_engine::error("Path is not a collection or does not exist [path={}]", collection.c_str());
-                    return OBJ_PATH_DOES_NOT_EXIST;
+            auto resume() noexcept -> void
+            {
+                if (!enabled()) {
+                    return;
                 }
 
-                std::string collection_id;
+                started_ = std::chrono::steady_clock::now();
+            }
 
-                for (auto&& row : irods::query{&conn, fmt::format("select COLL_ID where COLL_NAME = '{}'", collection.c_str())}) {
-                    collection_id = row[0];
+            auto paused() const noexcept -> bool
+            {
+                return started_ == std::chrono::steady_clock::time_point::max();
+            }
+
+        private:
+            call_kind kind_;
+            std::string arguments_;
+            std::chrono::system_clock::time_point start_;
+            std::chrono::steady_clock::time_point started_;
+            std::chrono::steady_clock::duration elapsed_{};
+            std::int64_t result_ = 0;
+        }; // class scoped_call
+
+        // A drop-in replacement for irods::query that records the query string, the number of
+        // rows consumed and the time spent waiting on the catalog (i.e. excluding the time the
+        // caller spends processing rows).
+        class query
+        {
+        public:
+            using query_type = irods::query<rsComm_t>;
+
+            class iterator
+            {
+            public:
+                iterator(query_type::iterator iter, query* q)
+                    : iter_{std::move(iter)}
+                    , query_{q}
+                {
                 }
 
-                if (collection_id.empty()) {
-                    log::rule_engine::error("Could not get collection id [collection={}]", collection.c_str());
-                    return SYS_INTERNAL_ERR;
+                decltype(auto) operator*()
+                {
+                    if (!counted_) {
+                        counted_ = true;
+                        query_->call_.result(++query_->rows_);
+                    }
+
+                    return *iter_;
                 }
 
-                addKeyVal(&reg_params, COLL_ID_KW, collection_id.c_str());
-            }
+                auto operator++() -> iterator&
+                {
+                    query_->call_.resume();
+                    ++iter_;
+                    query_->call_.pause();
+                    counted_ = false;
+                    return *this;
+                }
 
-            modDataObjMeta_t input{};
-            input.dataObjInfo = &info;
-            input.regParam = &reg_params;
+                auto operator==(const iterator& other) const -> bool
+                {
+                    return iter_ == other.iter_;
+                }
 
-            ix::scoped_privileged_client spc{conn};
+                auto operator!=(const iterator& other) const -> bool
+                {
+                    return !(*this == other);
+                }
 
-            return rsModDataObjMeta(&conn, &input);
-        }
+            private:
+                query_type::iterator iter_;
+                query* query_;
+                bool counted_ = false;
+            }; // class iterator
+
+            query(rsComm_t* conn, const std::string& gql, std::uintmax_t limit = 0)
+                : call_{call_kind::query, enabled() ? gql : std::string{}, {gql.c_str()}}
+                , query_{conn, gql, limit}
+            {
+                call_.pause();
+            }
 
-        auto set_replica_info(rsComm_t& conn,
-                              const fs::path& logical_path,
-                              const std::string_view replica_number,
-                              const std::string_view new_resource_id,
-                              const std::string_view new_resource_name,
-                              const boost::filesystem::path& new_physical_path) -> int
-        {
-            dataObjInfo_t info{};
-            rstrcpy(info.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            query(const query&) = delete;
+            auto operator=(const query&) -> query& = delete;
 
-            try {
-                info.replNum = std::stoi(replica_number.data());
+            auto begin() -> iterator
+            {
+                return {query_.begin(), this};
             }
-            catch (...) {
-                rodsLog(LOG_ERROR, "Could not convert replica number string to integer [path=%s, replica_number=%s]",
-                        logical_path.c_str(), replica_number.data());
-                return SYS_INTERNAL_ERR;
+
+            auto end() -> iterator
+            {
+                return {query_.end(), this};
             }
 
-            keyValPair_t reg_params{};
-            addKeyVal(&reg_params, RESC_ID_KW, new_resource_id.data());
-            addKeyVal(&reg_params, RESC_NAME_KW, new_resource_name.data());
-            addKeyVal(&reg_params, FILE_PATH_KW, new_physical_path.c_str());
+            auto size() -> std::size_t
+            {
+                return call_.result(query_.size());
+            }
 
-            modDataObjMeta_t input{};
-            input.dataObjInfo = &info;
-            input.regParam = &reg_params;
+        private:
+            scoped_call call_;
+            query_type query_;
+            std::int64_t rows_ = 0;
+        }; // class query
 
-            ix::scoped_privileged_client spc{conn};
+        namespace detail
+        {
+            template <typename Function>
+            auto invoke_metadata_call(call_kind kind, const fs::path& p, const fs::metadata& md, Function&& func) -> void
+            {
+                scoped_call call{kind, join(p.string(), md.attribute, md.value, md.units), {p.c_str(), md.value.c_str()}};
 
-            return rsModDataObjMeta(&conn, &input);
-        }
+                try {
+                    func();
+                }
+                catch (const fs::filesystem_error& e) {
+                    call.result(e.code().value());
+                    throw;
+                }
+            }
+        } // namespace detail
 
-        auto find_hard_link(const std::vector<hard_link>& hl_info, std::string_view resource_id) noexcept
-            -> std::optional<std::reference_wrapper<const hard_link>>
+        auto add_metadata(rsComm_t& conn, const fs::path& p, const fs::metadata& md) -> void
         {
-            const auto end = std::end(hl_info);
-            const auto iter = std::find_if(std::begin(hl_info), end, [resource_id](const auto& e) noexcept {
-                return e.resource_id == resource_id;
-            });
+            detail::invoke_metadata_call(call_kind::add_metadata, p, md, [&] { fs::server::add_metadata(conn, p, md); });
+        }
 
-            if (iter != end) {
-                return std::ref(*iter);
-            }
+        auto remove_metadata(rsComm_t& conn, const fs::path& p, const fs::metadata& md) -> void
+        {
+            detail::invoke_metadata_call(call_kind::remove_metadata, p, md, [&] { fs::server::remove_metadata(conn, p, md); });
+        }
 
-            return std::nullopt;
+        auto set_metadata(rsComm_t& conn, const fs::path& p, const fs::metadata& md) -> void
+        {
+            detail::invoke_metadata_call(call_kind::set_metadata, p, md, [&] { fs::server::set_metadata(conn, p, md); });
         }
 
-        auto generate_new_uuid(rsComm_t& conn, std::string_view resource_id) -> std::string
+        namespace detail
         {
-            auto uuid = to_string(boost::uuids::random_generator{}());
+            template <typename Function>
+            auto invoke_atomic_call(call_kind kind, const fs::path& p, const json& input, Function&& func) -> void
+            {
+                scoped_call call{kind, enabled() ? join(p.string(), input.at("operations").dump()) : std::string{}, {p.c_str()}};
 
-            const auto* query = "select DATA_NAME "
-                                "where"
-                                " META_DATA_ATTR_NAME = 'irods::hard_link' and"
-                                " META_DATA_ATTR_VALUE = '{}' and"
-                                " META_DATA_ATTR_UNITS = '{}'";
+                char* output = nullptr;
+                const auto ec = call.result(func(input.dump().c_str(), &output));
 
-            while (true) {
-                if (irods::query{&conn, fmt::format(query, uuid, resource_id)}.size() == 0) {
-                    break;
+                std::string error_message;
+
+                if (output) {
+                    error_message = output;
+                    std::free(output);
                 }
 
-                uuid = to_string(boost::uuids::random_generator{}());
+                if (ec < 0) {
+                    THROW(ec, fmt::format("Atomic catalog update failed [path={}, output={}]", p.c_str(), error_message));
+                }
             }
-
-            return uuid;
-        }
-
-        auto replace_hard_link_metadata(rsComm_t& conn,
-                                        const fs::path& logical_path,
-                                        const hard_link& hard_link,
-                                        std::string_view new_resource_id) -> void
+        } // namespace detail
+
+        // Applies every operation to the entity's metadata in a single catalog transaction.
+        // The operations use the format of rs_atomic_apply_metadata_operations.
+        auto apply_metadata_operations(rsComm_t& conn,
+                                       const fs::path& p,
+                                       json operations,
+                                       std::string_view entity_type = "data_object") -> void
         {
-            log::rule_engine::debug("Updating hard link info [data_object={}]", logical_path.c_str());
-
-            try {
-                auto md = util::make_hard_link_avu(hard_link.uuid, hard_link.resource_id);
-                fs::server::remove_metadata(conn, logical_path, md);
+            json input{
+                {"entity_name", p.c_str()},
+                {"entity_type", std::string{entity_type}},
+                {"operations", std::move(operations)}
+            };
 
-                md.units = new_resource_id;
-                fs::server::add_metadata(conn, logical_path, md);
-            }
-            catch (const fs::filesystem_error& e) {
-                log::rule_engine::error("Could not replace hard link metadata. [error_code={}, error_message={}, data_object={}]",
-                                        e.code().value(), e.what(), logical_path.c_str());
+            // Collections and resources are written on behalf of clients that may not own them.
+            if (entity_type != "data_object") {
+                input["admin_mode"] = true;
             }
+
+            detail::invoke_atomic_call(call_kind::atomic_metadata, p, input, [&conn](const char* in, char** out) {
+                return rs_atomic_apply_metadata_operations(&conn, in, out);
+            });
         }
 
-        auto resolve_resource(std::string_view resource_name) -> irods::resource_ptr
+        // Applies every operation to the data object's ACL in a single catalog transaction. The
+        // operations use the format of rs_atomic_apply_acl_operations.
+        auto apply_acl_operations(rsComm_t& conn, const fs::path& p, json operations) -> void
         {
-            irods::resource_ptr p;
-
-            if (const auto e = resc_mgr.resolve(resource_name.data(), p); !e.ok()) {
-                const auto msg = fmt::format("Could not resolve resource name to a resource id [resource_name={}]", resource_name);
-                THROW(CAT_INVALID_RESOURCE_NAME, msg);
-            }
+            const json input{
+                {"logical_path", p.c_str()},
+                {"operations", std::move(operations)}
+            };
 
-            return p;
+            detail::invoke_atomic_call(call_kind::atomic_acl, p, input, [&conn](const char* in, char** out) {
+                return rs_atomic_apply_acl_operations(&conn, in, out);
+            });
         }
+    } // namespace trace
 
-        auto convert_physical_object_to_dataObjInfo_t(const irods::physical_object& _obj) -> dataObjInfo_t
+    //
+    // Path Scoping
+    //
+
+    namespace scope
+    {
+        // A trie of collection names. Paths are matched one collection name at a time, so
+        // "/tempZone/home/alice" covers "/tempZone/home/alice/foo" but not "/tempZone/home/alice2".
+        // Lookups do not allocate.
+        class prefix_trie
         {
-            dataObjInfo_t info{};
+        public:
+            auto insert(std::string_view collection, bool include) -> void
+            {
+                if (include) {
+                    default_ = false;
+                }
+
+                auto* n = &root_;
+
+                for_each_name(collection, [&n](std::string_view name) {
+                    if (auto iter = n->children.find(name); iter != std::end(n->children)) {
+                        n = &iter->second;
+                    }
+                    else {
+                        n = &n->children.emplace(std::string{name}, node{}).first->second;
+                    }
+
+                    return true;
+                });
+
+                n->include = include;
+            }
+
+            // Returns true if the path is in scope.
+            auto contains(std::string_view path) const noexcept -> bool
+            {
+                return match(path).first;
+            }
+
+            // Returns true if the collection and everything under it are in scope.
+            auto contains_tree(std::string_view collection) const noexcept -> bool
+            {
+                const auto [in_scope, n] = match(collection);
+                return in_scope && (!n || !n->has_exclusions_below);
+            }
+
+            // Propagates the exclusions to their ancestors. Must be called after the last insert.
+            auto finalize() -> void
+            {
+                mark_exclusions(root_);
+            }
+
+        private:
+            struct node
+            {
+                std::map<std::string, node, std::less<>> children;
+                std::optional<bool> include;
+                bool has_exclusions_below = false;
+            };
+
+            template <typename Function>
+            static auto for_each_name(std::string_view path, Function func) -> void
+            {
+                while (!path.empty()) {
+                    const auto pos = path.find('/');
+                    const auto name = path.substr(0, pos);
+
+                    if (!name.empty() && !func(name)) {
+                        return;
+                    }
+
+                    if (pos == std::string_view::npos) {
+                        return;
+                    }
+
+                    path.remove_prefix(pos + 1);
+                }
+            }
+
+            static auto mark_exclusions(node& n) -> bool
+            {
+                for (auto&& [name, child] : n.children) {
+                    if (mark_exclusions(child) || child.include == false) {
+                        n.has_exclusions_below = true;
+                    }
+                }
+
+                return n.has_exclusions_below;
+            }
+
+            // Returns whether the path is in scope, and the node for the path itself if the
+            // trie holds one.
+            auto match(std::string_view path) const noexcept -> std::pair<bool, const node*>
+            {
+                const auto* n = &root_;
+                auto in_scope = root_.include.value_or(default_);
+
+                for_each_name(path, [&n, &in_scope](std::string_view name) {
+                    const auto iter = n->children.find(name);
+
+                    if (iter == std::end(n->children)) {
+                        n = nullptr;
+                        return false;
+                    }
+
+                    n = &iter->second;
+                    in_scope = n->include.value_or(in_scope);
+
+                    return true;
+                });
+
+                return {in_scope, n};
+            }
+
+            node root_;
+            bool default_ = true;
+        }; // class prefix_trie
+
+        auto paths() -> prefix_trie&
+        {
+            static prefix_trie trie;
+            return trie;
+        }
+
+        // Returns true if the data object may be part of a hard link group.
+        auto contains(std::string_view path) noexcept -> bool
+        {
+            return paths().contains(path);
+        }
+    } // namespace scope
+
+    namespace util
+    {
+        auto get_rei(irods::callback& effect_handler) -> ruleExecInfo_t&
+        {
+            ruleExecInfo_t* rei{};
+            irods::error result{effect_handler("unsafe_ms_ctx", &rei)};
+
+            if (!result.ok()) {
+                THROW(result.code(), "failed to get rule execution info");
+            }
+
+            return *rei;
+        }
+
+        auto log_exception(const irods::exception& e) -> void
+        {
+            log::rule_engine::error("{} [error_code={}]", e.what(), e.code());
+        }
+
+        auto make_hard_link_avu(std::string_view uuid, std::string_view resource_id) -> fs::metadata
+        {
+            return {"irods::hard_link", uuid.data(), resource_id.data()};
+        }
+
+        template <typename T>
+        auto get_input_object_ptr(std::list<boost::any>& rule_arguments) -> T*
+        {
+            return boost::any_cast<T*>(*std::next(std::begin(rule_arguments), 2));
+        }
+
+        // Returns the collection and data name of a logical path as views into the path. Unlike
+        // parent_path() and object_name(), this does not build two temporary paths.
+        auto split_logical_path(const fs::path& p) noexcept -> std::pair<std::string_view, std::string_view>
+        {
+            const std::string_view s = p.c_str();
+            const auto pos = s.rfind('/');
+
+            if (pos == std::string_view::npos) {
+                return {"", s};
+            }
+
+            return {s.substr(0, std::max<std::size_t>(pos, 1)), s.substr(pos + 1)};
+        }
+
+        // Joins a collection and data name (e.g. the columns of a query row) with one allocation.
+        auto make_logical_path(std::string_view collection, std::string_view data_name) -> std::string
+        {
+            std::string p;
+            p.reserve(collection.size() + 1 + data_name.size());
+            p.append(collection);
+
+            if (p.empty() || p.back() != '/') {
+                p.push_back('/');
+            }
+
+            return p.append(data_name);
+        }
+
+        auto get_hard_links(rsComm_t& conn, const fs::path& p) -> std::vector<hard_link>
+        {
+            const auto [collection, data_name] = split_logical_path(p);
+            const auto gql = fmt::format("select META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " COLL_NAME = '{}' and"
+                                         " DATA_NAME = '{}'",
+                                         collection,
+                                         data_name);
+
+            std::vector<hard_link> data;
+
+            // Rows are returned by value, so their strings are moved rather than copied.
+            for (auto&& row : trace::query{&conn, gql}) {
+                data.push_back({std::move(row[0]), std::move(row[1])});
+            }
+
+            return data;
+        }
+
+        // A lazy, single-pass range over the logical paths of the members of a hard link group.
+        // Members are fetched from the catalog one page at a time in data id order, and every page
+        // resumes after the last data id seen. Memory use is bounded by the page size, and the
+        // hard link metadata of members already visited may be modified while iterating.
+        class hard_link_member_range
+        {
+        public:
+            class iterator
+            {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type        = fs::path;
+                using difference_type   = std::ptrdiff_t;
+                using pointer           = const fs::path*;
+                using reference         = const fs::path&;
+
+                iterator() = default;
+
+                explicit iterator(hard_link_member_range* range)
+                    : range_{range->page_.empty() ? nullptr : range}
+                {
+                }
+
+                auto operator*() const -> reference
+                {
+                    return range_->page_[range_->index_];
+                }
+
+                auto operator->() const -> pointer
+                {
+                    return &range_->page_[range_->index_];
+                }
+
+                auto operator++() -> iterator&
+                {
+                    if (!range_->next()) {
+                        range_ = nullptr;
+                    }
+
+                    return *this;
+                }
+
+                auto operator==(const iterator& other) const noexcept -> bool
+                {
+                    return range_ == other.range_;
+                }
+
+                auto operator!=(const iterator& other) const noexcept -> bool
+                {
+                    return !(*this == other);
+                }
+
+            private:
+                hard_link_member_range* range_ = nullptr;
+            }; // class iterator
+
+            hard_link_member_range(rsComm_t& conn,
+                                   std::string_view uuid,
+                                   std::string_view resource_id,
+                                   std::uintmax_t page_size)
+                : conn_{&conn}
+                , uuid_{uuid}
+                , resource_id_{resource_id}
+                , page_size_{std::max<std::uintmax_t>(page_size, 1)}
+            {
+            }
+
+            hard_link_member_range(const hard_link_member_range&) = delete;
+            auto operator=(const hard_link_member_range&) -> hard_link_member_range& = delete;
+
+            auto begin() -> iterator
+            {
+                last_data_id_ = "0";
+                fetch_page();
+                return iterator{this};
+            }
+
+            auto end() -> iterator
+            {
+                return {};
+            }
+
+        private:
+            // Returns false once every member has been visited.
+            auto next() -> bool
+            {
+                if (++index_ < page_.size()) {
+                    return true;
+                }
+
+                // A short page means the catalog has no more rows to return.
+                if (page_.size() < page_size_) {
+                    return false;
+                }
+
+                fetch_page();
+
+                return !page_.empty();
+            }
+
+            auto fetch_page() -> void
+            {
+                const auto gql = fmt::format("select order(DATA_ID), COLL_NAME, DATA_NAME "
+                                             "where"
+                                             " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                             " META_DATA_ATTR_VALUE = '{}' and"
+                                             " META_DATA_ATTR_UNITS = '{}' and"
+                                             " DATA_ID > '{}'", uuid_, resource_id_, last_data_id_);
+
+                page_.clear();
+                index_ = 0;
+
+                for (auto&& row : trace::query{conn_, gql, page_size_}) {
+                    last_data_id_ = std::move(row[0]);
+                    page_.emplace_back(make_logical_path(row[1], row[2]));
+                }
+            }
+
+            rsComm_t* conn_;
+            std::string uuid_;
+            std::string resource_id_;
+            std::uintmax_t page_size_;
+            std::string last_data_id_;
+            std::vector<fs::path> page_;
+            std::size_t index_ = 0;
+        }; // class hard_link_member_range
+
+        // A member of a hard link group and every replica it has.
+        struct hard_link_member
+        {
+            std::string data_id;
+            fs::path logical_path;
+            std::vector<data_object_info> replicas;
+        };
+
+        // Returns the members of the hard link group whose data id is greater than "after_data_id",
+        // in data id order, together with all of their replicas. The page is read with a single
+        // query of at most "page_size" rows, so a member with several replicas takes several rows.
+        // A member whose rows may have been cut off by the limit is left for the next page. An
+        // empty page means every member has been returned.
+        auto get_hard_link_member_page(rsComm_t& conn,
+                                       std::string_view uuid,
+                                       std::string_view resource_id,
+                                       std::string_view after_data_id,
+                                       std::uintmax_t page_size) -> std::vector<hard_link_member>
+        {
+            const auto load = [&](std::string_view condition, std::uintmax_t limit) {
+                const auto gql = fmt::format("select order(DATA_ID), COLL_NAME, DATA_NAME, DATA_PATH, DATA_REPL_NUM, RESC_NAME, RESC_ID, "
+                                             "DATA_SIZE, DATA_OWNER_NAME, DATA_OWNER_ZONE "
+                                             "where"
+                                             " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                             " META_DATA_ATTR_VALUE = '{}' and"
+                                             " META_DATA_ATTR_UNITS = '{}' and"
+                                             " {}", uuid, resource_id, condition);
+
+                std::vector<hard_link_member> members;
+                std::uintmax_t rows = 0;
+
+                for (auto&& row : trace::query{&conn, gql, limit}) {
+                    if (members.empty() || members.back().data_id != row[0]) {
+                        members.push_back({std::move(row[0]), make_logical_path(row[1], row[2]), {}});
+                    }
+
+                    members.back().replicas.push_back({std::move(row[3]), std::move(row[4]), std::move(row[5]), std::move(row[6]),
+                                                       std::move(row[7]), std::move(row[8]), std::move(row[9])});
+                    ++rows;
+                }
+
+                return std::make_pair(std::move(members), rows);
+            };
+
+            page_size = std::max<std::uintmax_t>(page_size, 1);
+
+            auto [members, rows] = load(fmt::format("DATA_ID > '{}'", after_data_id), page_size);
+
+            if (rows < page_size) {
+                return std::move(members);
+            }
+
+            // The page is full, so the rows of the last member may be incomplete.
+            if (members.size() > 1) {
+                members.pop_back();
+                return std::move(members);
+            }
+
+            // A single member has more replicas than fit in a page. Read all of them.
+            return load(fmt::format("DATA_ID = '{}'", members.front().data_id), 0).first;
+        }
+
+        // Returns the number of members in the hard link group, but stops counting once "limit"
+        // members have been seen. Callers only need to tell a few small sizes apart (e.g. "empty",
+        // "one member" or "more"), so the catalog never has to return the whole group.
+        auto count_hard_link_members(rsComm_t& conn,
+                                     std::string_view uuid,
+                                     std::string_view resource_id,
+                                     std::uintmax_t limit) -> std::int64_t
+        {
+            const auto gql = fmt::format("select DATA_ID "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}'", uuid, resource_id);
+
+            std::int64_t count = 0;
+
+            for (auto&& row : trace::query{&conn, gql, limit}) {
+                static_cast<void>(row);
+                ++count;
+            }
+
+            return count;
+        }
+
+        // Returns the logical path of the only member of the hard link group. If the group is
+        // empty or has more than one member, an empty optional is returned. At most two rows
+        // are ever fetched, so the cost does not depend on the size of the group.
+        auto get_sole_hard_link_member(rsComm_t& conn,
+                                       std::string_view uuid,
+                                       std::string_view resource_id) -> std::optional<fs::path>
+        {
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}'", uuid, resource_id);
+
+            std::optional<fs::path> member;
+
+            for (auto&& row : trace::query{&conn, gql, 2}) {
+                if (member) {
+                    return std::nullopt;
+                }
+
+                member = util::make_logical_path(row[0], row[1]);
+            }
+
+            return member;
+        }
+
+        auto get_replicas(rsComm_t& conn, const fs::path& p) -> std::vector<data_object_info>
+        {
+            const auto [collection, data_name] = split_logical_path(p);
+            const auto gql = fmt::format("select DATA_PATH, DATA_REPL_NUM, RESC_NAME, RESC_ID, DATA_SIZE, DATA_OWNER_NAME, DATA_OWNER_ZONE "
+                                         "where COLL_NAME = '{}' and DATA_NAME = '{}'",
+                                         collection,
+                                         data_name);
+
+            std::vector<data_object_info> replicas;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                replicas.push_back({std::move(row[0]), std::move(row[1]), std::move(row[2]), std::move(row[3]),
+                                    std::move(row[4]), std::move(row[5]), std::move(row[6])});
+            }
+
+            return replicas;
+        }
+
+        auto find_replica(rsComm_t& conn, const fs::path& p, std::string_view resource_id) -> std::optional<data_object_info>
+        {
+            for (auto&& info : get_replicas(conn, p)) {
+                if (info.resource_id == resource_id) {
+                    return std::move(info);
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        // Parses the "replica_number" of a link request. It holds a single replica number, "all",
+        // or a JSON array of replica numbers. Returns std::nullopt for "all".
+        auto parse_replica_numbers(const std::string& replica_number) -> std::optional<std::vector<std::string>>
+        {
+            if (replica_number == "all") {
+                return std::nullopt;
+            }
+
+            if (replica_number.empty() || replica_number.front() != '[') {
+                return std::vector<std::string>{replica_number};
+            }
+
+            std::vector<std::string> replica_numbers;
+
+            try {
+                for (auto&& e : json::parse(replica_number)) {
+                    replica_numbers.push_back(e.is_string() ? e.get<std::string>() : e.dump());
+                }
+            }
+            catch (const json::exception&) {
+                THROW(USER_INPUT_FORMAT_ERR, fmt::format("Invalid replica number list [replica_number={}]", replica_number));
+            }
+
+            if (replica_numbers.empty()) {
+                THROW(USER_INVALID_REPLICA_INPUT, "The replica number list is empty");
+            }
+
+            return replica_numbers;
+        }
+
+        // Returns true if "link_name" is already a hard link to every requested replica of
+        // "source" (i.e. both data objects belong to the same group for each replica and reference
+        // the same physical path on the same resource). Both data objects are read with a single
+        // query. Rows pairing one data object's collection with the other's name are ignored.
+        auto is_existing_hard_link(rsComm_t& conn,
+                                   const fs::path& source,
+                                   const std::string& replica_number,
+                                   const fs::path& link_name) -> bool
+        {
+            const auto [src_collection, src_data_name] = split_logical_path(source);
+            const auto [link_collection, link_data_name] = split_logical_path(link_name);
+
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, DATA_REPL_NUM, DATA_PATH, RESC_ID, META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " COLL_NAME in ('{}', '{}') and"
+                                         " DATA_NAME in ('{}', '{}')",
+                                         src_collection, link_collection,
+                                         src_data_name, link_data_name);
+
+            // The hard linked replicas of each data object, keyed by replica number for the source
+            // and by group for the link.
+            std::map<std::string, std::array<std::string, 4>> source_replicas;
+            std::set<std::array<std::string, 4>> link_replicas;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                const auto path = make_logical_path(row[0], row[1]);
+
+                if (path == source.c_str()) {
+                    // Every replica is paired with every hard link of the data object. Only the
+                    // pairing that names the replica's resource describes the replica.
+                    if (row[4] == row[6]) {
+                        source_replicas[row[2]] = {std::move(row[5]), std::move(row[6]), std::move(row[3]), std::move(row[4])};
+                    }
+                }
+                else if (path == link_name.c_str() && row[4] == row[6]) {
+                    link_replicas.insert({std::move(row[5]), std::move(row[6]), std::move(row[3]), std::move(row[4])});
+                }
+            }
+
+            std::set<std::string> replica_numbers;
+
+            // "all" covers every replica of the source, including replicas that are not hard linked
+            // yet. The rows above only hold the hard linked ones.
+            if (const auto requested = parse_replica_numbers(replica_number); requested) {
+                replica_numbers = {std::begin(*requested), std::end(*requested)};
+            }
+            else {
+                for (auto&& info : get_replicas(conn, source)) {
+                    replica_numbers.insert(std::move(info.replica_number));
+                }
+            }
+
+            if (replica_numbers.empty()) {
+                return false;
+            }
+
+            return std::all_of(std::begin(replica_numbers), std::end(replica_numbers), [&](const std::string& rn) {
+                const auto iter = source_replicas.find(rn);
+                return iter != std::end(source_replicas) && link_replicas.count(iter->second) > 0;
+            });
+        }
+
+        auto register_replica(rsComm_t& conn,
+                              const data_object_info& replica_info,
+                              std::string_view link_name,
+                              const std::string& group,
+                              bool update_parent_mtime = true) -> int
+        {
+            dataObjInp_t input{};
+            addKeyVal(&input.condInput, FILE_PATH_KW, replica_info.physical_path.data());
+            addKeyVal(&input.condInput, REPL_NUM_KW, replica_info.replica_number.data());
+            addKeyVal(&input.condInput, DEST_RESC_NAME_KW, replica_info.resource_name.data());
+            rstrcpy(input.objPath, link_name.data(), MAX_NAME_LEN);
+
+            // Vanilla iRODS only allows administrators to register data objects.
+            // Elevate privileges so that all users can create hard links.
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::phy_path_reg,
+                                    trace::join(link_name, replica_info.physical_path, replica_info.resource_name),
+                                    {input.objPath, group.c_str(), replica_info.replica_number.c_str()}};
+
+            const auto ec = call.result(rsPhyPathReg(&conn, &input));
+
+            // Update the parent collection's mtime.
+            if (ec >= 0 && update_parent_mtime) {
+                const auto* local_zone = getLocalZoneName();
+
+                if (const auto zone = fs::zone_name(link_name.data()); zone && *zone == local_zone) {
+                    try {
+                        using std::chrono::system_clock;
+                        using std::chrono::time_point_cast;
+
+                        const auto now = time_point_cast<fs::object_time_type::duration>(system_clock::now());
+
+                        fs::server::last_write_time(conn, fs::path{link_name.data()}.parent_path(), now);
+                    }
+                    catch (const fs::filesystem_error& e) {
+                        rodsLog(LOG_ERROR, "Could not update the collection's mtime. [error_code=%d, collection=%s]",
+                                e.code().value(), e.path1().c_str());
+                    }
+                }
+            }
+
+            return ec;
+        };
+
+        // Registers another replica of an existing data object (i.e. a hard link that references
+        // more than one physical object).
+        auto register_additional_replica(rsComm_t& conn,
+                                         const data_object_info& replica_info,
+                                         std::string_view link_name,
+                                         const std::string& group) -> int
+        {
+            dataObjInp_t input{};
+            addKeyVal(&input.condInput, FILE_PATH_KW, replica_info.physical_path.data());
+            addKeyVal(&input.condInput, DEST_RESC_NAME_KW, replica_info.resource_name.data());
+            addKeyVal(&input.condInput, REG_REPL_KW, "");
+            rstrcpy(input.objPath, link_name.data(), MAX_NAME_LEN);
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::phy_path_reg,
+                                    trace::join(link_name, replica_info.physical_path, replica_info.resource_name),
+                                    {input.objPath, group.c_str(), replica_info.replica_number.c_str()}};
+
+            return call.result(rsPhyPathReg(&conn, &input));
+        }
+
+        auto unregister_replica(rsComm_t& conn,
+                                const fs::path& logical_path,
+                                const std::optional<std::string_view>& replica_number = std::nullopt,
+                                const std::string& group = {}) -> int
+        {
+            dataObjInp_t unreg_input{};
+            unreg_input.oprType = UNREG_OPR;
+            rstrcpy(unreg_input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            addKeyVal(&unreg_input.condInput, FORCE_FLAG_KW, "");
+
+            if (replica_number) {
+                addKeyVal(&unreg_input.condInput, REPL_NUM_KW, replica_number->data());
+            }
+
+            // Vanilla iRODS only allows administrators to register data objects.
+            // Elevate privileges so that all users can create hard links.
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::data_obj_unlink,
+                                    trace::join(logical_path.string(), replica_number.value_or(""), "unregister"),
+                                    {logical_path.c_str(), group.c_str(), replica_number ? replica_number->data() : ""}};
+
+            return call.result(rsDataObjUnlink(&conn, &unreg_input));
+        }
+
+        auto unlink_replica(rsComm_t& conn,
+                            const fs::path& logical_path,
+                            const std::optional<std::string_view>& replica_number = std::nullopt,
+                            const std::string& group = {}) -> int
+        {
+            dataObjInp_t unreg_input{};
+            rstrcpy(unreg_input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            addKeyVal(&unreg_input.condInput, FORCE_FLAG_KW, "");
+
+            if (replica_number) {
+                addKeyVal(&unreg_input.condInput, REPL_NUM_KW, replica_number->data());
+            }
+
+            trace::scoped_call call{trace::call_kind::data_obj_unlink,
+                                    trace::join(logical_path.string(), replica_number.value_or(""), "unlink"),
+                                    {logical_path.c_str(), group.c_str(), replica_number ? replica_number->data() : ""}};
+
+            return call.result(rsDataObjUnlink(&conn, &unreg_input));
+        }
+
+        // Moves the replica to another resource. Hard link metadata is not touched.
+        auto move_replica(rsComm_t& conn,
+                          const fs::path& logical_path,
+                          const std::string& replica_number,
+                          const std::string& src_resource_name,
+                          const std::string& dst_resource_name,
+                          const std::string& group = {}) -> int
+        {
+            dataObjInp_t input{};
+            rstrcpy(input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            addKeyVal(&input.condInput, REPL_NUM_KW, replica_number.c_str());
+            addKeyVal(&input.condInput, RESC_NAME_KW, src_resource_name.c_str());
+            addKeyVal(&input.condInput, DEST_RESC_NAME_KW, dst_resource_name.c_str());
+            addKeyVal(&input.condInput, ADMIN_KW, "");
+
+            trace::scoped_call call{trace::call_kind::data_obj_phymv,
+                                    trace::join(logical_path.string(), replica_number, src_resource_name, dst_resource_name),
+                                    {logical_path.c_str(), group.c_str(), replica_number.c_str()}};
+
+            transferStat_t* stat{};
+            const auto ec = call.result(rsDataObjPhymv(&conn, &input, &stat));
+            std::free(stat);
+
+            return ec;
+        }
+
+        auto set_logical_path(rsComm_t& conn,
+                              const fs::path& logical_path,
+                              const fs::path& new_logical_path,
+                              const std::string& group = {}) -> int
+        {
+            dataObjInfo_t info{};
+            rstrcpy(info.objPath, logical_path.c_str(), MAX_NAME_LEN);
+
+            keyValPair_t reg_params{};
+            addKeyVal(&reg_params, ALL_KW, "");
+
+            // Update the data name if the names are different.
+            if (const auto object_name = new_logical_path.object_name(); logical_path.object_name() != object_name) {
+                addKeyVal(&reg_params, DATA_NAME_KW, object_name.c_str());
+            }
+
+            // Update the collection id if the parent paths are different.
+            // (i.e. the data object is moving between collections)
+            //
+            // The id is looked up for every move. rsModDataObjMeta cannot make the update conditional
+            // on the collection still existing, so an id cached by one agent could be written after
+            // an agent on another server removed the collection, orphaning the data object.
+            if (const auto collection = new_logical_path.parent_path(); logical_path.parent_path() != collection) {
+                std::string collection_id;
+
+                // Only collections have a COLL_ID, so no row means the path is not a collection.
+                for (auto&& row : trace::query{&conn, fmt::format("select COLL_ID where COLL_NAME = '{}'", collection.c_str())}) {
+                    collection_id = row[0];
+                }
+
+                if (collection_id.empty()) {
+                    log::rule_engine::error("Path is not a collection or does not exist [path={}]", collection.c_str());
+                    return OBJ_PATH_DOES_NOT_EXIST;
+                }
+
+                addKeyVal(&reg_params, COLL_ID_KW, collection_id.c_str());
+            }
+
+            modDataObjMeta_t input{};
+            input.dataObjInfo = &info;
+            input.regParam = &reg_params;
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::mod_data_obj_meta,
+                                    trace::serialize(info.objPath, info.replNum, reg_params),
+                                    {info.objPath, group.c_str()}};
+
+            return call.result(rsModDataObjMeta(&conn, &input));
+        }
+
+        auto set_replica_info(rsComm_t& conn,
+                              const fs::path& logical_path,
+                              const std::string_view replica_number,
+                              const std::string_view new_resource_id,
+                              const std::string_view new_resource_name,
+                              const boost::filesystem::path& new_physical_path,
+                              const std::string& group = {}) -> int
+        {
+            dataObjInfo_t info{};
+            rstrcpy(info.objPath, logical_path.c_str(), MAX_NAME_LEN);
+
+            try {
+                info.replNum = std::stoi(replica_number.data());
+            }
+            catch (...) {
+                rodsLog(LOG_ERROR, "Could not convert replica number string to integer [path=%s, replica_number=%s]",
+                        logical_path.c_str(), replica_number.data());
+                return SYS_INTERNAL_ERR;
+            }
+
+            keyValPair_t reg_params{};
+            addKeyVal(&reg_params, RESC_ID_KW, new_resource_id.data());
+            addKeyVal(&reg_params, RESC_NAME_KW, new_resource_name.data());
+            addKeyVal(&reg_params, FILE_PATH_KW, new_physical_path.c_str());
+
+            modDataObjMeta_t input{};
+            input.dataObjInfo = &info;
+            input.regParam = &reg_params;
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::mod_data_obj_meta,
+                                    trace::serialize(info.objPath, info.replNum, reg_params),
+                                    {info.objPath, group.c_str(), replica_number.data()}};
+
+            return call.result(rsModDataObjMeta(&conn, &input));
+        }
+
+        auto set_data_size(rsComm_t& conn,
+                           const fs::path& logical_path,
+                           const std::string_view replica_number,
+                           const std::string_view data_size,
+                           const std::string& group = {}) -> int
+        {
+            dataObjInfo_t info{};
+            rstrcpy(info.objPath, logical_path.c_str(), MAX_NAME_LEN);
+
+            try {
+                info.replNum = std::stoi(replica_number.data());
+            }
+            catch (...) {
+                rodsLog(LOG_ERROR, "Could not convert replica number string to integer [path=%s, replica_number=%s]",
+                        logical_path.c_str(), replica_number.data());
+                return SYS_INTERNAL_ERR;
+            }
+
+            keyValPair_t reg_params{};
+            addKeyVal(&reg_params, DATA_SIZE_KW, data_size.data());
+
+            modDataObjMeta_t input{};
+            input.dataObjInfo = &info;
+            input.regParam = &reg_params;
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::scoped_call call{trace::call_kind::mod_data_obj_meta,
+                                    trace::serialize(info.objPath, info.replNum, reg_params),
+                                    {info.objPath, group.c_str(), replica_number.data()}};
+
+            return call.result(rsModDataObjMeta(&conn, &input));
+        }
+
+        auto find_hard_link(const std::vector<hard_link>& hl_info, std::string_view resource_id) noexcept
+            -> std::optional<std::reference_wrapper<const hard_link>>
+        {
+            const auto end = std::end(hl_info);
+            const auto iter = std::find_if(std::begin(hl_info), end, [resource_id](const auto& e) noexcept {
+                return e.resource_id == resource_id;
+            });
+
+            if (iter != end) {
+                return std::ref(*iter);
+            }
+
+            return std::nullopt;
+        }
+
+        auto generate_new_uuid(rsComm_t& conn, std::string_view resource_id) -> std::string
+        {
+            auto uuid = to_string(boost::uuids::random_generator{}());
+
+            const auto* query = "select DATA_NAME "
+                                "where"
+                                " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                " META_DATA_ATTR_VALUE = '{}' and"
+                                " META_DATA_ATTR_UNITS = '{}'";
+
+            while (true) {
+                if (trace::query{&conn, fmt::format(query, uuid, resource_id)}.size() == 0) {
+                    break;
+                }
+
+                uuid = to_string(boost::uuids::random_generator{}());
+            }
+
+            return uuid;
+        }
+
+        auto replace_hard_link_metadata(rsComm_t& conn,
+                                        const fs::path& logical_path,
+                                        const hard_link& hard_link,
+                                        std::string_view new_resource_id) -> void
+        {
+            log::rule_engine::debug("Updating hard link info [data_object={}]", logical_path.c_str());
+
+            // Both changes are made in one catalog transaction, so the member is never without the
+            // group's AVU.
+            try {
+                trace::apply_metadata_operations(conn, logical_path, json::array({
+                    {{"operation", "remove"}, {"attribute", "irods::hard_link"}, {"value", hard_link.uuid}, {"units", hard_link.resource_id}},
+                    {{"operation", "add"}, {"attribute", "irods::hard_link"}, {"value", hard_link.uuid}, {"units", new_resource_id}}
+                }));
+            }
+            catch (const irods::exception& e) {
+                log::rule_engine::error("Could not replace hard link metadata. [error_code={}, error_message={}, data_object={}]",
+                                        e.code(), e.what(), logical_path.c_str());
+            }
+        }
+
+        auto resolve_resource(std::string_view resource_name) -> irods::resource_ptr
+        {
+            irods::resource_ptr p;
+
+            if (const auto e = resc_mgr.resolve(resource_name.data(), p); !e.ok()) {
+                const auto msg = fmt::format("Could not resolve resource name to a resource id [resource_name={}]", resource_name);
+                THROW(CAT_INVALID_RESOURCE_NAME, msg);
+            }
+
+            return p;
+        }
+
+        auto convert_physical_object_to_dataObjInfo_t(const irods::physical_object& _obj) -> dataObjInfo_t
+        {
+            dataObjInfo_t info{};
 
             info.dataSize = _obj.size();
             info.dataId = _obj.id();
@@ -388,245 +1528,3503 @@ namespace
             info.dataMapId = _obj.map_id();
             info.rescId = _obj.resc_id();
 
-            rstrcpy(info.objPath, _obj.name().c_str(), sizeof(info.objPath));
-            rstrcpy(info.version, _obj.version().c_str(), sizeof(info.version));
-            rstrcpy(info.dataType, _obj.type_name().c_str(), sizeof(info.dataType));
-            rstrcpy(info.rescName, _obj.resc_name().c_str(), sizeof(info.rescName));
-            rstrcpy(info.filePath, _obj.path().c_str(), sizeof(info.filePath));
-            rstrcpy(info.dataOwnerName, _obj.owner_name().c_str(), sizeof(info.dataOwnerName));
-            rstrcpy(info.dataOwnerZone, _obj.owner_zone().c_str(), sizeof(info.dataOwnerZone));
-            rstrcpy(info.statusString, _obj.status().c_str(), sizeof(info.statusString));
-            rstrcpy(info.chksum, _obj.checksum().c_str(), sizeof(info.chksum));
-            rstrcpy(info.dataExpiry, _obj.expiry_ts().c_str(), sizeof(info.dataExpiry));
-            rstrcpy(info.dataMode, _obj.mode().c_str(), sizeof(info.dataMode));
-            rstrcpy(info.dataComments, _obj.r_comment().c_str(), sizeof(info.dataComments));
-            rstrcpy(info.dataCreate, _obj.create_ts().c_str(), sizeof(info.dataCreate));
-            rstrcpy(info.dataModify, _obj.modify_ts().c_str(), sizeof(info.dataModify));
-            rstrcpy(info.rescHier, _obj.resc_hier().c_str(), sizeof(info.rescHier));
+            rstrcpy(info.objPath, _obj.name().c_str(), sizeof(info.objPath));
+            rstrcpy(info.version, _obj.version().c_str(), sizeof(info.version));
+            rstrcpy(info.dataType, _obj.type_name().c_str(), sizeof(info.dataType));
+            rstrcpy(info.rescName, _obj.resc_name().c_str(), sizeof(info.rescName));
+            rstrcpy(info.filePath, _obj.path().c_str(), sizeof(info.filePath));
+            rstrcpy(info.dataOwnerName, _obj.owner_name().c_str(), sizeof(info.dataOwnerName));
+            rstrcpy(info.dataOwnerZone, _obj.owner_zone().c_str(), sizeof(info.dataOwnerZone));
+            rstrcpy(info.statusString, _obj.status().c_str(), sizeof(info.statusString));
+            rstrcpy(info.chksum, _obj.checksum().c_str(), sizeof(info.chksum));
+            rstrcpy(info.dataExpiry, _obj.expiry_ts().c_str(), sizeof(info.dataExpiry));
+            rstrcpy(info.dataMode, _obj.mode().c_str(), sizeof(info.dataMode));
+            rstrcpy(info.dataComments, _obj.r_comment().c_str(), sizeof(info.dataComments));
+            rstrcpy(info.dataCreate, _obj.create_ts().c_str(), sizeof(info.dataCreate));
+            rstrcpy(info.dataModify, _obj.modify_ts().c_str(), sizeof(info.dataModify));
+            rstrcpy(info.rescHier, _obj.resc_hier().c_str(), sizeof(info.rescHier));
+
+            return info;
+        }
+
+        auto get_minimum_age_in_minutes(const ix::key_value_proxy<keyValPair_t>& _kvp) -> std::chrono::minutes
+        {
+            if (const auto iter = _kvp.find(AGE_KW); iter != std::end(_kvp)) {
+                if (const auto v = std::atoi((*iter).value().data()); v > 0) {
+                    return std::chrono::minutes{v};
+                }
+            }
+
+            return std::chrono::minutes{0};;
+        }
+
+        auto get_minimum_replica_count(const ix::key_value_proxy<keyValPair_t>& _kvp) -> std::size_t
+        {
+            if (const auto iter = _kvp.find(COPIES_KW); iter != std::end(_kvp)) {
+                try {
+                    if (const auto value = std::stoull((*iter).value().data()); value > 0) {
+                        return value;
+                    }
+                }
+                catch (...) {}
+            }
+
+            return DEF_MIN_COPY_CNT;
+        }
+
+        // Builds the replica list directly from the catalog. Unlike resolving the resource hierarchy,
+        // this does not trigger a resource vote, which may contact every server in the hierarchy.
+        // Hierarchies are derived from the resource manager's in-memory resource map.
+        auto get_physical_objects(rsComm_t& _conn, const fs::path& _path) -> std::vector<irods::physical_object>
+        {
+            const auto gql = fmt::format("select DATA_ID, COLL_ID, DATA_REPL_NUM, DATA_VERSION, DATA_TYPE_NAME, DATA_SIZE,"
+                                         " RESC_ID, RESC_NAME, DATA_PATH, DATA_OWNER_NAME, DATA_OWNER_ZONE, DATA_REPL_STATUS,"
+                                         " DATA_STATUS, DATA_CHECKSUM, DATA_EXPIRY, DATA_MAP_ID, DATA_MODE, DATA_COMMENTS,"
+                                         " DATA_CREATE_TIME, DATA_MODIFY_TIME "
+                                         "where COLL_NAME = '{}' and DATA_NAME = '{}'",
+                                         _path.parent_path().c_str(),
+                                         _path.object_name().c_str());
+
+            std::vector<irods::physical_object> replicas;
+
+            for (auto&& row : trace::query{&_conn, gql}) {
+                const auto resc_id = std::stoll(row[6]);
+
+                std::string resc_hier;
+                if (const auto err = resc_mgr.leaf_id_to_hier(resc_id, resc_hier); !err.ok()) {
+                    THROW(err.code(), fmt::format("Could not resolve resource id to hierarchy [resource_id={}]", resc_id));
+                }
+
+                irods::physical_object obj;
+                obj.name(_path.c_str());
+                obj.id(std::stoll(row[0]));
+                obj.coll_id(std::stoll(row[1]));
+                obj.repl_num(std::stoi(row[2]));
+                obj.version(row[3]);
+                obj.type_name(row[4]);
+                obj.size(std::stoll(row[5]));
+                obj.resc_id(resc_id);
+                obj.resc_name(row[7]);
+                obj.path(row[8]);
+                obj.owner_name(row[9]);
+                obj.owner_zone(row[10]);
+                obj.replica_status(std::stoi(row[11]));
+                obj.status(row[12]);
+                obj.checksum(row[13]);
+                obj.expiry_ts(row[14]);
+                obj.map_id(std::stoi(row[15]));
+                obj.mode(row[16]);
+                obj.r_comment(row[17]);
+                obj.create_ts(row[18]);
+                obj.modify_ts(row[19]);
+                obj.resc_hier(resc_hier);
+
+                replicas.push_back(std::move(obj));
+            }
+
+            if (replicas.empty()) {
+                THROW(OBJ_PATH_DOES_NOT_EXIST, fmt::format("Data object does not exist [path={}]", _path.c_str()));
+            }
+
+            return replicas;
+        }
+
+        auto get_replica_list(rsComm_t& _conn, dataObjInp_t& _input) -> std::vector<irods::physical_object>
+        {
+            ix::key_value_proxy kvp{_input.condInput};
+
+            // The resource hierarchy only needs to be resolved (i.e. voted on) when a specific
+            // hierarchy is targeted. Otherwise, all replicas are candidates for trimming.
+            if (!kvp.contains(RESC_HIER_STR_KW)) {
+                return get_physical_objects(_conn, _input.objPath);
+            }
+
+            irods::file_object_ptr file_obj{new irods::file_object{}};
+            irods::error fac_err = irods::file_object_factory(&_conn, &_input, file_obj);
+
+            if (!fac_err.ok()) {
+                THROW(fac_err.code(), "file_object_factory failed");
+            }
+
+            return file_obj->replicas();
+        }
+
+        auto get_list_of_replicas_to_trim(dataObjInp_t& _input, const std::vector<irods::physical_object>& _replicas)
+            -> std::vector<irods::physical_object>
+        {
+            std::vector<irods::physical_object> trim_list;
+
+            const auto good_replica_count = std::count_if(std::begin(_replicas), std::end(_replicas), [](const auto& repl) {
+                return (repl.replica_status() & 0x0F) == GOOD_REPLICA;
+            });
+
+            ix::key_value_proxy kvp{_input.condInput};
+            const auto minimum_replica_count = get_minimum_replica_count(kvp);
+
+            using clock_type = std::chrono::system_clock;
+
+            const auto replica_meets_age_requirement =
+                [min_age = util::get_minimum_age_in_minutes(kvp), now = clock_type::now()](std::string_view _timestamp_in_secs)
+                {
+                    const clock_type::time_point last_modified{std::chrono::seconds{std::atoi(_timestamp_in_secs.data())}};
+                    return now - last_modified >= min_age;
+                };
+
+            // If a specific replica number is specified, only trim that one!
+            if (const auto iter = kvp.find(REPL_NUM_KW); iter != std::end(kvp)) {
+                try {
+                    const auto end = std::end(_replicas);
+                    const auto repl = std::find_if(std::begin(_replicas), end,
+                        [n = std::stoi((*iter).value().data())](const auto& _r) {
+                            return n == _r.repl_num();
+                        });
+
+                    if (repl == end) {
+                        THROW(SYS_REPLICA_DOES_NOT_EXIST, "Target replica does not exist");
+                    }
+
+                    if (!replica_meets_age_requirement(repl->modify_ts())) {
+                        THROW(USER_INCOMPATIBLE_PARAMS, "Target replica is not old enough for removal");
+                    }
+
+                    if (good_replica_count <= minimum_replica_count && (repl->replica_status() & 0x0F) == GOOD_REPLICA) {
+                        THROW(USER_INCOMPATIBLE_PARAMS, "Cannot remove the last good replica");
+                    }
+
+                    trim_list.push_back(*repl);
+
+                    return trim_list;
+                }
+                catch (const std::invalid_argument& e) {
+                    log::rule_engine::error(e.what());
+                    THROW(USER_INVALID_REPLICA_INPUT, "Invalid replica number requested");
+                }
+                catch (const std::out_of_range& e) {
+                    log::rule_engine::error(e.what());
+                    THROW(USER_INVALID_REPLICA_INPUT, "Invalid replica number requested");
+                }
+            }
+
+            const auto resc_name = kvp.contains(RESC_NAME_KW) ? kvp[RESC_NAME_KW].value() : "";
+            const auto matches_target_resource = [&resc_name](const irods::physical_object& _obj) {
+                return irods::hierarchy_parser{_obj.resc_hier()}.first_resc() == resc_name;
+            };
+
+            // Walk list and add stale replicas to the list.
+            for (const auto& obj : _replicas) {
+                if ((obj.replica_status() & 0x0F) == STALE_REPLICA) {
+                    if (!replica_meets_age_requirement(obj.modify_ts()) || (!resc_name.empty() && !matches_target_resource(obj))) {
+                        continue;
+                    }
+
+                    trim_list.push_back(obj);
+                }
+            }
+
+            if (good_replica_count <= minimum_replica_count) {
+                return trim_list;
+            }
+
+            // If we have not reached the minimum count, walk list again and add good replicas.
+            std::size_t good_replicas_to_be_trimmed = 0;
+
+            for (const auto& obj : _replicas) {
+                if ((obj.replica_status() & 0x0F) == GOOD_REPLICA) {
+                    if (!replica_meets_age_requirement(obj.modify_ts()) || (!resc_name.empty() && !matches_target_resource(obj))) {
+                        continue;
+                    }
+
+                    if (good_replica_count - good_replicas_to_be_trimmed <= minimum_replica_count) {
+                        return trim_list;
+                    }
+
+                    trim_list.push_back(obj);
+                    ++good_replicas_to_be_trimmed;
+                }
+            }
+
+            return trim_list;
+        }
+
+        // Returns a GenQuery condition matching the collection and every collection under it.
+        // "_" and "%" in the collection name are wildcards to the LIKE operator, so the condition
+        // can also match sibling trees. Callers must filter rows with is_in_collection_tree.
+        auto make_collection_tree_condition(const fs::path& collection) -> std::string
+        {
+            return fmt::format("COLL_NAME = '{0}' || like '{0}/%'", collection.c_str());
+        }
+
+        // Returns true if the collection name is the collection or one of its descendants.
+        auto is_in_collection_tree(const fs::path& collection, std::string_view coll_name) -> bool
+        {
+            const std::string_view prefix = collection.c_str();
+
+            return coll_name.substr(0, prefix.size()) == prefix &&
+                   (coll_name.size() == prefix.size() || coll_name[prefix.size()] == '/');
+        }
+
+        // FNV-1a. The hash must be identical across all agents (and plugin builds), so std::hash
+        // is not an option.
+        auto hash(std::string_view key) noexcept -> std::uint64_t
+        {
+            std::uint64_t h = 14695981039346656037ULL;
+
+            for (auto c : key) {
+                h ^= static_cast<unsigned char>(c);
+                h *= 1099511628211ULL;
+            }
+
+            return h;
+        }
+
+        // Returns the name of the host the agent runs on. Identifies state that is kept per host.
+        auto get_host_name() -> const std::string&
+        {
+            static const std::string host_name = [] {
+                char buffer[256]{};
+
+                if (gethostname(buffer, sizeof(buffer) - 1) != 0) {
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not get the host name [errno={}]", errno));
+                }
+
+                return std::string{buffer};
+            }();
+
+            return host_name;
+        }
+
+        // Adds the hard link metadata of every group to the data object in a single catalog transaction.
+        auto add_hard_link_metadata(rsComm_t& conn, const fs::path& p, const std::vector<hard_link>& groups) -> void
+        {
+            if (groups.empty()) {
+                return;
+            }
+
+            auto operations = json::array();
+
+            for (auto&& hl : groups) {
+                operations.push_back({
+                    {"operation", "add"},
+                    {"attribute", "irods::hard_link"},
+                    {"value", hl.uuid},
+                    {"units", hl.resource_id}
+                });
+            }
+
+            trace::apply_metadata_operations(conn, p, std::move(operations));
+        }
+
+        // The names accepted by the atomic ACL API, or nullptr for permissions it cannot express.
+        auto to_acl_name(fs::perms p) noexcept -> const char*
+        {
+            switch (p) {
+                case fs::perms::null:          return "null";
+                case fs::perms::read_object:   return "read";
+                case fs::perms::modify_object: return "write";
+                case fs::perms::own:           return "own";
+                default:                       return nullptr;
+            }
+        }
+
+        // Copies the ACL in a single catalog transaction. Permissions that the atomic ACL API cannot
+        // express (e.g. read_metadata) are set individually afterwards.
+        auto copy_permissions(rsComm_t& conn, const fs::path& from, const fs::path& to) -> void
+        {
+            auto operations = json::array();
+            std::vector<fs::entity_permission> remaining;
+
+            for (auto&& e : fs::server::status(conn, from).permissions()) {
+                if (const auto* acl = to_acl_name(e.prms); acl) {
+                    operations.push_back({{"entity_name", e.name}, {"acl", acl}});
+                }
+                else {
+                    remaining.push_back(e);
+                }
+            }
+
+            if (!operations.empty()) {
+                trace::apply_acl_operations(conn, to, std::move(operations));
+            }
+
+            for (auto&& e : remaining) {
+                fs::server::permissions(conn, to, e.name, e.prms);
+            }
+        }
+
+        auto update_collection_mtime(rsComm_t& _conn,
+                                     const fs::path& _path1,
+                                     const std::optional<fs::path> _path2 = std::nullopt) -> void
+        {
+            try {
+                // Update the mtime of the source and destination collections if the paths reference
+                // collections in the local zone.
+
+                using std::chrono::system_clock;
+                using std::chrono::time_point_cast;
+
+                const auto now = time_point_cast<fs::object_time_type::duration>(system_clock::now());
+
+                ix::scoped_privileged_client spc{_conn};
+
+                const auto* local_zone = getLocalZoneName();
+
+                if (const auto zone = fs::zone_name(_path1); zone && *zone == local_zone) {
+                    if (fs::server::is_collection_registered(_conn, _path1)) {
+                        fs::server::last_write_time(_conn, _path1, now);
+                    }
+                }
+
+                if (_path2 && _path1 != *_path2) {
+                    if (const auto zone = fs::zone_name(*_path2); zone && *zone == local_zone) {
+                        if (fs::server::is_collection_registered(_conn, *_path2)) {
+                            fs::server::last_write_time(_conn, *_path2, now);
+                        }
+                    }
+                }
+            }
+            catch (const fs::filesystem_error& e) {
+                if (_path2) {
+                    rodsLog(LOG_ERROR, "Could not update mtime of one or more collections. [path_1=%s, path_2=%s]",
+                            _path1.c_str(), _path2->c_str());
+                }
+                else {
+                    rodsLog(LOG_ERROR, "Could not update mtime of one or more collections. [path=%s]", _path1.c_str());
+                }
+            }
+        }
+    } // namespace util
+
+    //
+    // Group Locking
+    //
+
+    namespace locking
+    {
+        // Returns the key identifying the physical object a hard link group is formed around.
+        // Unlike the group's UUID, this key is known before the group exists (i.e. while creating
+        // a hard link), so every operation that modifies a group locks it.
+        auto make_lock_key(std::string_view resource_id, std::string_view physical_path) -> std::string
+        {
+            return fmt::format("{}:{}", resource_id, physical_path);
+        }
+
+        // A fixed-size table of lock files shared by all agents on the host. Keys are hashed
+        // onto a stripe so that only operations on the same key (or keys that happen to share
+        // a stripe) are serialized.
+        //
+        // Locks are reentrant within an agent. Because flock(2) locks belong to the open file
+        // description, acquiring the same stripe twice would otherwise silently release the
+        // outer lock when the inner lock is released.
+        class stripe_table
+        {
+        public:
+            stripe_table(std::string_view name, std::size_t stripe_count)
+                : name_{name}
+                , fds_(std::max<std::size_t>(stripe_count, 1), -1)
+                , depth_(fds_.size(), 0)
+            {
+            }
+
+            ~stripe_table()
+            {
+                for (auto fd : fds_) {
+                    if (fd != -1) {
+                        close(fd);
+                    }
+                }
+            }
+
+            auto stripe_of(std::string_view key) const noexcept -> std::size_t
+            {
+                return util::hash(key) % fds_.size();
+            }
+
+            auto lock(std::size_t stripe) -> void
+            {
+                if (depth_[stripe]++ > 0) {
+                    return;
+                }
+
+                const auto fd = open_stripe(stripe);
+
+                while (flock(fd, LOCK_EX) == -1) {
+                    if (errno != EINTR) {
+                        --depth_[stripe];
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not lock hard link stripe [stripe={}, errno={}]", stripe, errno));
+                    }
+                }
+            }
+
+            // Returns false instead of waiting when another agent holds the stripe.
+            auto try_lock(std::size_t stripe) -> bool
+            {
+                if (depth_[stripe]++ > 0) {
+                    return true;
+                }
+
+                const auto fd = open_stripe(stripe);
+
+                while (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+                    if (errno == EWOULDBLOCK) {
+                        --depth_[stripe];
+                        return false;
+                    }
+
+                    if (errno != EINTR) {
+                        --depth_[stripe];
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not lock hard link stripe [stripe={}, errno={}]", stripe, errno));
+                    }
+                }
+
+                return true;
+            }
+
+            auto unlock(std::size_t stripe) noexcept -> void
+            {
+                if (--depth_[stripe] > 0) {
+                    return;
+                }
+
+                if (flock(fds_[stripe], LOCK_UN) == -1) {
+                    log::rule_engine::error("Could not unlock hard link stripe [stripe={}, errno={}]", stripe, errno);
+                }
+            }
+
+            auto size() const noexcept -> std::size_t
+            {
+                return fds_.size();
+            }
+
+            // Returns true if this agent holds any stripe of the table.
+            auto held() const noexcept -> bool
+            {
+                return std::any_of(std::begin(depth_), std::end(depth_), [](auto depth) { return depth > 0; });
+            }
+
+            stripe_table(const stripe_table&) = delete;
+            auto operator=(const stripe_table&) -> stripe_table& = delete;
+
+        private:
+            auto open_stripe(std::size_t stripe) -> int
+            {
+                if (fds_[stripe] != -1) {
+                    return fds_[stripe];
+                }
+
+                if (mkdir(config.lock_directory.c_str(), S_IRWXU) == -1 && errno != EEXIST) {
+                    --depth_[stripe];
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not create lock directory [path={}, errno={}]",
+                                                        config.lock_directory, errno));
+                }
+
+                const auto path = fmt::format("{}/{}_{}.lock", config.lock_directory, name_, stripe);
+
+                if (fds_[stripe] = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR); fds_[stripe] == -1) {
+                    --depth_[stripe];
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not open lock file [path={}, errno={}]", path, errno));
+                }
+
+                return fds_[stripe];
+            }
+
+            std::string name_;
+            std::vector<int> fds_;
+            std::vector<int> depth_;
+        }; // class stripe_table
+
+        // The locks protecting hard link groups.
+        auto group_locks() -> stripe_table&
+        {
+            static stripe_table table{"group", config.lock_stripe_count};
+            return table;
+        }
+
+        // The locks protecting the storage usage counters. These are always acquired after (never
+        // before) a group lock, which is why they live in a separate table.
+        auto usage_locks() -> stripe_table&
+        {
+            static stripe_table table{"usage", 64};
+            return table;
+        }
+
+        // Holds the stripe lock for a key for the lifetime of the object.
+        class scoped_lock
+        {
+        public:
+            scoped_lock(stripe_table& table, std::string_view key)
+                : table_{table}
+                , stripe_{table.stripe_of(key)}
+            {
+                log::rule_engine::trace("Acquiring hard link lock [key={}, stripe={}]", key, stripe_);
+                table_.lock(stripe_);
+            }
+
+            ~scoped_lock()
+            {
+                table_.unlock(stripe_);
+            }
+
+            scoped_lock(const scoped_lock&) = delete;
+            auto operator=(const scoped_lock&) -> scoped_lock& = delete;
+
+        private:
+            stripe_table& table_;
+            std::size_t stripe_;
+        }; // class scoped_lock
+
+        // Holds the stripe locks for several keys for the lifetime of the object. Stripes are
+        // acquired in ascending order so that agents locking overlapping keys cannot deadlock.
+        class scoped_multi_lock
+        {
+        public:
+            scoped_multi_lock(stripe_table& table, const std::vector<std::string>& keys)
+                : table_{table}
+            {
+                for (auto&& key : keys) {
+                    stripes_.push_back(table.stripe_of(key));
+                }
+
+                std::sort(std::begin(stripes_), std::end(stripes_));
+                stripes_.erase(std::unique(std::begin(stripes_), std::end(stripes_)), std::end(stripes_));
+
+                log::rule_engine::trace("Acquiring hard link locks [stripes={}]", stripes_.size());
+
+                try {
+                    for (auto stripe : stripes_) {
+                        table_.lock(stripe);
+                        ++locked_;
+                    }
+                }
+                catch (...) {
+                    release();
+                    throw;
+                }
+            }
+
+            ~scoped_multi_lock()
+            {
+                release();
+            }
+
+            scoped_multi_lock(const scoped_multi_lock&) = delete;
+            auto operator=(const scoped_multi_lock&) -> scoped_multi_lock& = delete;
+
+        private:
+            auto release() noexcept -> void
+            {
+                while (locked_ > 0) {
+                    table_.unlock(stripes_[--locked_]);
+                }
+            }
+
+            stripe_table& table_;
+            std::vector<std::size_t> stripes_;
+            std::size_t locked_ = 0;
+        }; // class scoped_multi_lock
+    } // namespace locking
+
+    //
+    // Admission Control
+    //
+
+    namespace admission
+    {
+        // The slots shared by all agents on the host.
+        auto slots() -> locking::stripe_table&
+        {
+            static locking::stripe_table table{"fanout", config.fanout_slots};
+            return table;
+        }
+
+        // Paces an operation that performs catalog writes for many data objects (e.g. updating
+        // every member of a hard link group). The first chunk runs unrestricted, so small operations
+        // never wait. Beyond that, the operation requires one of the slots shared by all agents
+        // using the lock directory.
+        //
+        // Slots are always acquired before group locks. An agent holding a group lock (or another
+        // slot) never waits for a slot, so a slot holder waiting for a group lock cannot deadlock
+        // with the agent holding that lock.
+        class fanout
+        {
+        public:
+            // For operations that do not hold a group lock while calling admit() (e.g. snapshots,
+            // which lock each link separately). The slot is released between chunks, so concurrent
+            // fan-outs take turns instead of flooding the catalog.
+            fanout() = default;
+
+            // For operations that hold a group lock while updating "size" data objects (e.g. moving
+            // every member of a group). Must be constructed before the group lock is taken. If the
+            // operation exceeds a chunk, a slot is acquired here and held until the fan-out ends,
+            // and admit() only applies the rate limit.
+            explicit fanout(std::uintmax_t size)
+                : reserved_{true}
+            {
+                if (size > std::max<std::uintmax_t>(config.fanout_chunk_size, 1)) {
+                    acquire();
+                }
+            }
+
+            ~fanout()
+            {
+                release();
+            }
+
+            fanout(const fanout&) = delete;
+            auto operator=(const fanout&) -> fanout& = delete;
+
+            // Must be called before processing each data object. Blocks while all slots are taken
+            // or the agent is over its rate limit.
+            auto admit() -> void
+            {
+                if (!reserved_ && count_ > 0 && count_ % std::max<std::uintmax_t>(config.fanout_chunk_size, 1) == 0) {
+                    release();
+                    acquire();
+                }
+
+                ++count_;
+
+                pace();
+            }
+
+        private:
+            auto acquire() -> void
+            {
+                if (config.fanout_slots == 0) {
+                    return;
+                }
+
+                auto& table = slots();
+                const auto first = static_cast<std::size_t>(getpid()) % table.size();
+                const auto try_acquire = [&] {
+                    for (std::size_t i = 0; i < table.size(); ++i) {
+                        if (const auto slot = (first + i) % table.size(); table.try_lock(slot)) {
+                            slot_ = slot;
+                            return true;
+                        }
+                    }
+
+                    return false;
+                };
+
+                // Waiting while holding a group lock or a slot could close a cycle with another agent,
+                // so such an agent (e.g. one whose group grew after it was sized) proceeds without a slot.
+                if (locking::group_locks().held() || table.held()) {
+                    if (!try_acquire()) {
+                        log::rule_engine::debug("Proceeding without a fan-out slot while holding a hard link lock");
+                    }
+
+                    return;
+                }
+
+                auto backoff = std::chrono::milliseconds{1};
+
+                while (!try_acquire()) {
+                    std::this_thread::sleep_for(backoff);
+                    backoff = std::min(backoff * 2, std::chrono::milliseconds{100});
+                }
+            }
+
+            auto release() noexcept -> void
+            {
+                if (slot_) {
+                    slots().unlock(*slot_);
+                    slot_.reset();
+                }
+            }
+
+            auto pace() -> void
+            {
+                if (config.fanout_rate_limit == 0) {
+                    return;
+                }
+
+                using clock_type = std::chrono::steady_clock;
+
+                const auto interval = std::chrono::duration_cast<clock_type::duration>(
+                    std::chrono::duration<double>{1.0 / config.fanout_rate_limit});
+
+                if (const auto now = clock_type::now(); next_ > now) {
+                    std::this_thread::sleep_until(next_);
+                }
+                else {
+                    next_ = now;
+                }
+
+                next_ += interval;
+            }
+
+            bool reserved_ = false;
+            std::uintmax_t count_ = 0;
+            std::optional<std::size_t> slot_;
+            std::chrono::steady_clock::time_point next_{};
+        }; // class fanout
+    } // namespace admission
+
+    //
+    // Storage Usage
+    //
+
+    namespace usage
+    {
+        // Counters are stored as AVUs on the zone collection so that reading all of them
+        // requires a single query. Every server keeps its own set of counters, holding the
+        // changes made by its agents, and the totals are the sums over all servers. Each AVU has
+        // the following form:
+        //
+        //   attribute: irods::hard_links::usage::<host>::resource::<resource_id>
+        //              irods::hard_links::usage::<host>::owner::<user_name>#<zone_name>
+        //   value:     physical bytes (each physical object counted once)
+        //   units:     logical bytes (each hard link group member counted)
+        //
+        // A server only ever writes its own counters, so the host-local usage locks are enough
+        // to serialize updates, and servers never overwrite each other's changes. The counters
+        // of a single server may be negative (e.g. a link created on one server and removed on
+        // another).
+        //
+        // Only hard linked data objects are counted. Deduplicated usage is therefore the sum of
+        // DATA_SIZE over all replicas minus (logical bytes - physical bytes).
+
+        constexpr std::string_view attribute_prefix = "irods::hard_links::usage::";
+        constexpr std::string_view resource_prefix  = "resource::";
+        constexpr std::string_view owner_prefix     = "owner::";
+
+        using delta_map = std::map<std::string, std::pair<std::int64_t, std::int64_t>>;
+
+        auto zone_collection() -> fs::path
+        {
+            return fs::path{"/"} / getLocalZoneName();
+        }
+
+        auto make_resource_key(std::string_view resource_id) -> std::string
+        {
+            return fmt::format("{}{}", resource_prefix, resource_id);
+        }
+
+        auto make_owner_key(std::string_view owner_name, std::string_view owner_zone) -> std::string
+        {
+            return fmt::format("{}{}#{}", owner_prefix, owner_name, owner_zone);
+        }
+
+        // The attribute holding this server's share of the counter.
+        auto make_attribute(std::string_view key) -> std::string
+        {
+            return fmt::format("{}{}::{}", attribute_prefix, util::get_host_name(), key);
+        }
+
+        auto count_members_owned_by(rsComm_t& conn,
+                                    const hard_link& hl,
+                                    const data_object_info& member,
+                                    std::uintmax_t limit) -> std::int64_t
+        {
+            const auto gql = fmt::format("select DATA_ID "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}' and"
+                                         " DATA_OWNER_NAME = '{}' and"
+                                         " DATA_OWNER_ZONE = '{}'",
+                                         hl.uuid, hl.resource_id, member.owner_name, member.owner_zone);
+
+            std::int64_t count = 0;
+
+            // The callers only care whether the owner has zero, one or more members in the group.
+            for (auto&& row : trace::query{&conn, gql, limit}) {
+                static_cast<void>(row);
+                ++count;
+            }
+
+            return count;
+        }
+
+        // Adds the deltas to this server's counters. The current values of every counter touched
+        // are read with one query and all of them are written in one catalog transaction.
+        auto apply(rsComm_t& conn, const delta_map& deltas) -> void
+        {
+            std::vector<std::string> keys;
+            std::string attributes;
+
+            for (auto&& [key, delta] : deltas) {
+                if (delta.first != 0 || delta.second != 0) {
+                    attributes += fmt::format("{}'{}'", keys.empty() ? "" : ", ", make_attribute(key));
+                    keys.push_back(key);
+                }
+            }
+
+            if (keys.empty()) {
+                return;
+            }
+
+            locking::scoped_multi_lock lock{locking::usage_locks(), keys};
+
+            const auto collection = zone_collection();
+            const auto gql = fmt::format("select META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE, META_COLL_ATTR_UNITS "
+                                         "where COLL_NAME = '{}' and META_COLL_ATTR_NAME in ({})",
+                                         collection.c_str(), attributes);
+
+            std::map<std::string, std::pair<std::string, std::string>> current;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                current.insert_or_assign(std::move(row[0]), std::make_pair(std::move(row[1]), std::move(row[2])));
+            }
+
+            auto operations = json::array();
+
+            for (auto&& key : keys) {
+                const auto attribute = make_attribute(key);
+                auto [physical_bytes, logical_bytes] = deltas.at(key);
+
+                if (const auto iter = current.find(attribute); iter != std::end(current)) {
+                    const auto& [value, units] = iter->second;
+                    physical_bytes += std::stoll(value);
+                    logical_bytes += std::stoll(units);
+                    operations.push_back({{"operation", "remove"}, {"attribute", attribute}, {"value", value}, {"units", units}});
+                }
+
+                operations.push_back({
+                    {"operation", "add"},
+                    {"attribute", attribute},
+                    {"value", std::to_string(physical_bytes)},
+                    {"units", std::to_string(logical_bytes)}
+                });
+            }
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::apply_metadata_operations(conn, collection, std::move(operations), "collection");
+        }
+
+        // Usage tracking must never cause a hard link operation to fail. Errors are logged and
+        // the counters can be recomputed with "hard_links_usage_rebuild".
+        template <typename Function>
+        auto update(std::string_view event, Function&& func) noexcept -> void
+        {
+            try {
+                func();
+            }
+            catch (const irods::exception& e) {
+                log::rule_engine::error("Could not update hard link storage usage [event={}, error_code={}, error_message={}]",
+                                        event, e.code(), e.what());
+            }
+            catch (const std::exception& e) {
+                log::rule_engine::error("Could not update hard link storage usage [event={}, error_message={}]", event, e.what());
+            }
+        }
+
+        // Accumulates counter changes so that each operation writes its counters once.
+        class batch
+        {
+        public:
+            auto add(const std::string& key, std::int64_t physical_delta, std::int64_t logical_delta) -> void
+            {
+                auto& [physical, logical] = deltas_[key];
+                physical += physical_delta;
+                logical += logical_delta;
+            }
+
+            auto flush(rsComm_t& conn, std::string_view event = "batch") -> void
+            {
+                update(event, [&] { apply(conn, deltas_); });
+                deltas_.clear();
+            }
+
+        private:
+            delta_map deltas_;
+        }; // class batch
+
+        // Must be called after the hard link metadata has been attached to the new link and, if the
+        // group is new, to the source data object. The changes are added to the batch, so that a
+        // link with several replicas writes its counters once.
+        auto record_link_created(rsComm_t& conn,
+                                 batch& counters,
+                                 const hard_link& hl,
+                                 const data_object_info& source,
+                                 const data_object_info& link,
+                                 bool new_group) -> void
+        {
+            update("link_created", [&] {
+                const auto size = std::stoll(link.data_size);
+
+                if (new_group) {
+                    counters.add(make_resource_key(hl.resource_id), size, 2 * size);
+                    counters.add(make_owner_key(source.owner_name, source.owner_zone), size, size);
+                }
+                else {
+                    counters.add(make_resource_key(hl.resource_id), 0, size);
+                }
+
+                const auto owned = count_members_owned_by(conn, hl, link, 2);
+                counters.add(make_owner_key(link.owner_name, link.owner_zone), owned == 1 ? size : 0, size);
+            });
+        }
+
+        // Must be called after the hard link metadata has been removed from the member (or the
+        // member has been removed from the catalog).
+        auto record_member_removed(rsComm_t& conn, const hard_link& hl, const data_object_info& member) -> void
+        {
+            batch counters;
+
+            update("member_removed", [&] {
+                const auto size = std::stoll(member.data_size);
+                const auto remaining = util::count_hard_link_members(conn, hl.uuid, hl.resource_id, 1);
+                const auto owned = count_members_owned_by(conn, hl, member, 1);
+
+                counters.add(make_resource_key(hl.resource_id), remaining == 0 ? -size : 0, -size);
+                counters.add(make_owner_key(member.owner_name, member.owner_zone), owned == 0 ? -size : 0, -size);
+            });
+
+            counters.flush(conn, "member_removed");
+        }
+
+        // Adds the changes to the batch, so that operations moving many groups write their counters once.
+        auto record_group_moved(batch& counters,
+                                std::string_view src_resource_id,
+                                std::string_view dst_resource_id,
+                                std::int64_t size,
+                                std::int64_t member_count) -> void
+        {
+            counters.add(make_resource_key(src_resource_id), -size, -size * member_count);
+            counters.add(make_resource_key(dst_resource_id), size, size * member_count);
+        }
+
+        auto record_group_moved(rsComm_t& conn,
+                                std::string_view src_resource_id,
+                                std::string_view dst_resource_id,
+                                std::int64_t size,
+                                std::int64_t member_count) -> void
+        {
+            batch counters;
+            record_group_moved(counters, src_resource_id, dst_resource_id, size, member_count);
+            counters.flush(conn, "group_moved");
+        }
+
+        // Returns the counters of every server, keyed by attribute.
+        auto read_all(rsComm_t& conn) -> std::map<std::string, std::pair<std::string, std::string>>
+        {
+            const auto gql = fmt::format("select META_COLL_ATTR_NAME, META_COLL_ATTR_VALUE, META_COLL_ATTR_UNITS "
+                                         "where COLL_NAME = '{}' and META_COLL_ATTR_NAME like '{}%'",
+                                         zone_collection().c_str(), attribute_prefix);
+
+            std::map<std::string, std::pair<std::string, std::string>> counters;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                counters.insert_or_assign(std::move(row[0]), std::make_pair(std::move(row[1]), std::move(row[2])));
+            }
+
+            return counters;
+        }
+
+        auto to_json(rsComm_t& conn) -> json
+        {
+            delta_map totals;
+
+            for (auto&& [attribute, counter] : read_all(conn)) {
+                std::string_view name = attribute;
+                name.remove_prefix(attribute_prefix.size());
+
+                // Skip the host name.
+                if (const auto pos = name.find("::"); pos != std::string_view::npos) {
+                    auto& [physical, logical] = totals[std::string{name.substr(pos + 2)}];
+                    physical += std::stoll(counter.first);
+                    logical += std::stoll(counter.second);
+                }
+            }
+
+            auto resources = json::object();
+            auto owners = json::object();
+
+            for (auto&& [key, total] : totals) {
+                const json counters{
+                    {"physical_bytes", total.first},
+                    {"logical_bytes", total.second}
+                };
+
+                if (key.compare(0, resource_prefix.size(), resource_prefix) == 0) {
+                    resources[key.substr(resource_prefix.size())] = counters;
+                }
+                else if (key.compare(0, owner_prefix.size(), owner_prefix) == 0) {
+                    owners[key.substr(owner_prefix.size())] = counters;
+                }
+            }
+
+            return {{"resources", resources}, {"owners", owners}};
+        }
+
+        // Recomputes every counter from the hard link metadata in the catalog. The counters of all
+        // servers are replaced by the result, which is stored as this server's counters. The hard
+        // link AVUs are read in group order, so only the owners of one group are held at a time.
+        //
+        // Changes made by other servers while the catalog is read are lost, so this should run
+        // while no hard links are being created or removed.
+        auto rebuild(rsComm_t& conn) -> void
+        {
+            const std::string gql = "select order(META_DATA_ATTR_VALUE), order(META_DATA_ATTR_UNITS), DATA_ID, RESC_ID, DATA_SIZE, DATA_OWNER_NAME, DATA_OWNER_ZONE "
+                                    "where META_DATA_ATTR_NAME = 'irods::hard_link'";
+
+            delta_map totals;
+            std::pair<std::string, std::string> group;
+            std::set<std::string> owners;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                // Every replica of a member is paired with the group's AVU. Only the replica on the
+                // group's resource is part of the group.
+                if (row[3] != row[1]) {
+                    continue;
+                }
+
+                const auto size = std::stoll(row[4]);
+                const auto resource_key = make_resource_key(row[1]);
+                const auto owner_key = make_owner_key(row[5], row[6]);
+
+                if (group.first != row[0] || group.second != row[1]) {
+                    group = {row[0], row[1]};
+                    owners.clear();
+                    totals[resource_key].first += size;
+                }
+
+                totals[resource_key].second += size;
+                totals[owner_key].second += size;
+
+                if (owners.insert(owner_key).second) {
+                    totals[owner_key].first += size;
+                }
+            }
+
+            std::vector<std::string> keys;
+
+            for (auto&& [key, total] : totals) {
+                keys.push_back(key);
+            }
+
+            locking::scoped_multi_lock lock{locking::usage_locks(), keys};
+
+            auto operations = json::array();
+
+            for (auto&& [attribute, counter] : read_all(conn)) {
+                operations.push_back({{"operation", "remove"}, {"attribute", attribute}, {"value", counter.first}, {"units", counter.second}});
+            }
+
+            for (auto&& [key, total] : totals) {
+                operations.push_back({
+                    {"operation", "add"},
+                    {"attribute", make_attribute(key)},
+                    {"value", std::to_string(total.first)},
+                    {"units", std::to_string(total.second)}
+                });
+            }
+
+            if (operations.empty()) {
+                return;
+            }
+
+            ix::scoped_privileged_client spc{conn};
+
+            trace::apply_metadata_operations(conn, zone_collection(), std::move(operations), "collection");
+        }
+    } // namespace usage
+
+    //
+    // Change Events
+    //
+
+    namespace events
+    {
+        // Changes to hard link groups are appended to a log shared by all agents on the host, so
+        // that consumers (e.g. indexers) can follow them instead of scanning the catalog. The log
+        // is a directory of segments, each named after the sequence number of its first event
+        // ("<sequence>.events", zero padded to 20 digits). Every line of a segment is an event:
+        //
+        //   {"sequence": 42, "host": "<host name>", "time": <milliseconds since the Unix epoch>, "type": "member_added", ...}
+        //
+        // Sequence numbers start at 1 and increase across all agents on the host. Each server has its
+        // own log, so an event is identified by its host and sequence number. A number is reserved in the
+        // "state" file before the event is written, so a crash may leave a gap (or a partial final
+        // line) but never reuses a number. Segments are not modified once a newer one exists.
+        // Removing old segments is left to the consumers.
+
+        inline auto enabled() noexcept -> bool
+        {
+            return !config.event_log_directory.empty();
+        }
+
+        namespace detail
+        {
+            // Closing the descriptor releases the lock.
+            class locked_state
+            {
+            public:
+                locked_state()
+                {
+                    const auto path = fmt::format("{}/state", config.event_log_directory);
+
+                    if (fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR); fd_ == -1) {
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not open event log state [path={}, errno={}]", path, errno));
+                    }
+
+                    while (flock(fd_, LOCK_EX) == -1) {
+                        if (errno != EINTR) {
+                            close(fd_);
+                            THROW(SYS_INTERNAL_ERR, fmt::format("Could not lock event log state [path={}, errno={}]", path, errno));
+                        }
+                    }
+
+                    char buf[64]{};
+
+                    if (pread(fd_, buf, sizeof(buf) - 1, 0) > 0) {
+                        char* end = nullptr;
+                        next_sequence = std::strtoull(buf, &end, 10);
+                        segment = std::strtoull(end, nullptr, 10);
+                    }
+
+                    next_sequence = std::max<std::uint64_t>(next_sequence, 1);
+                    segment = std::clamp<std::uint64_t>(segment, 1, next_sequence);
+                }
+
+                ~locked_state()
+                {
+                    close(fd_);
+                }
+
+                locked_state(const locked_state&) = delete;
+                auto operator=(const locked_state&) -> locked_state& = delete;
+
+                auto save() -> void
+                {
+                    const auto s = fmt::format("{} {}\n", next_sequence, segment);
+
+                    if (pwrite(fd_, s.data(), s.size(), 0) != static_cast<ssize_t>(s.size()) ||
+                        ftruncate(fd_, s.size()) == -1 ||
+                        fdatasync(fd_) == -1)
+                    {
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not update event log state [errno={}]", errno));
+                    }
+                }
+
+                std::uint64_t next_sequence = 1;
+                std::uint64_t segment = 1;
+
+            private:
+                int fd_ = -1;
+            }; // class locked_state
+
+            auto open_segment(std::uint64_t first_sequence) -> std::pair<int, std::string>
+            {
+                auto path = fmt::format("{}/{:020}.events", config.event_log_directory, first_sequence);
+
+                if (const auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR); fd != -1) {
+                    return {fd, std::move(path)};
+                }
+
+                THROW(SYS_INTERNAL_ERR, fmt::format("Could not open event log segment [path={}, errno={}]", path, errno));
+            }
+        } // namespace detail
+
+        // Collects the events of an operation so that they are written together, with consecutive
+        // sequence numbers, once the catalog has been updated.
+        class batch
+        {
+        public:
+            auto add(std::string_view type, json event) -> void
+            {
+                if (enabled()) {
+                    event["type"] = type;
+                    events_.push_back(std::move(event));
+                }
+            }
+
+            auto size() const noexcept -> std::size_t
+            {
+                return events_.size();
+            }
+
+            // The catalog has already been updated at this point, so failures are logged rather
+            // than failing the operation.
+            auto publish() noexcept -> void
+            {
+                if (events_.empty()) {
+                    return;
+                }
+
+                try {
+                    if (mkdir(config.event_log_directory.c_str(), S_IRWXU) == -1 && errno != EEXIST) {
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not create event log directory [path={}, errno={}]",
+                                                            config.event_log_directory, errno));
+                    }
+
+                    detail::locked_state state;
+
+                    auto [fd, path] = detail::open_segment(state.segment);
+
+                    if (struct stat st{}; fstat(fd, &st) == 0 && static_cast<std::uintmax_t>(st.st_size) >= config.event_log_segment_size) {
+                        close(fd);
+                        state.segment = state.next_sequence;
+                        std::tie(fd, path) = detail::open_segment(state.segment);
+                    }
+
+                    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+
+                    std::string lines;
+
+                    const auto& host = util::get_host_name();
+
+                    for (auto&& e : events_) {
+                        e["sequence"] = state.next_sequence++;
+                        e["host"] = host;
+                        e["time"] = now;
+                        lines += e.dump();
+                        lines += '\n';
+                    }
+
+                    try {
+                        state.save();
+
+                        for (std::size_t written = 0; written < lines.size();) {
+                            if (const auto n = write(fd, lines.data() + written, lines.size() - written); n >= 0) {
+                                written += n;
+                            }
+                            else if (errno != EINTR) {
+                                THROW(SYS_INTERNAL_ERR, fmt::format("Could not write event log segment [path={}, errno={}]", path, errno));
+                            }
+                        }
+                    }
+                    catch (...) {
+                        close(fd);
+                        throw;
+                    }
+
+                    close(fd);
+                }
+                catch (const irods::exception& e) {
+                    log::rule_engine::error("Could not publish hard link events [event_count={}, error_code={}, error_message={}]",
+                                            events_.size(), e.code(), e.what());
+                }
+                catch (const std::exception& e) {
+                    log::rule_engine::error("Could not publish hard link events [event_count={}, error_message={}]",
+                                            events_.size(), e.what());
+                }
+
+                events_.clear();
+            }
+
+        private:
+            std::vector<json> events_;
+        }; // class batch
+
+        auto make_event(const hard_link& hl) -> json
+        {
+            return {{"uuid", hl.uuid}, {"resource_id", hl.resource_id}};
+        }
+    } // namespace events
+
+    //
+    // Bulk Operations
+    //
+
+    namespace bulk
+    {
+        struct link_entry
+        {
+            data_object_info replica;
+            std::string uuid;
+        };
+
+        // The marker attached to the destination collection of a snapshot until it is complete.
+        constexpr const char* snapshot_attribute = "irods::hard_links::snapshot";
+
+        // Maps logical paths to the replica that is (or will be) hard linked.
+        using link_entry_map = std::map<std::string, link_entry>;
+
+        // Lists the data objects under the collection matching the condition. Only one good replica
+        // (the one with the lowest replica number) of each data object is returned. Data objects
+        // without a good replica cannot be linked and are appended to "skipped".
+        auto list_data_objects(rsComm_t& conn,
+                               const fs::path& collection,
+                               std::string_view condition,
+                               std::vector<std::string>& skipped) -> link_entry_map
+        {
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, DATA_PATH, DATA_REPL_NUM, RESC_NAME, RESC_ID,"
+                                         " DATA_SIZE, DATA_OWNER_NAME, DATA_OWNER_ZONE, DATA_REPL_STATUS "
+                                         "where {}", condition);
+
+            link_entry_map entries;
+            std::set<std::string> without_good_replica;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                if (!util::is_in_collection_tree(collection, row[0])) {
+                    continue;
+                }
+
+                auto path = util::make_logical_path(row[0], row[1]);
+
+                if (row[9] != "1") {
+                    if (entries.count(path) == 0) {
+                        without_good_replica.insert(std::move(path));
+                    }
+
+                    continue;
+                }
+
+                without_good_replica.erase(path);
+
+                auto& e = entries[path];
+
+                if (e.replica.replica_number.empty() || std::stoi(row[3]) < std::stoi(e.replica.replica_number)) {
+                    e.replica = {std::move(row[2]), std::move(row[3]), std::move(row[4]), std::move(row[5]),
+                                 std::move(row[6]), std::move(row[7]), std::move(row[8])};
+                }
+            }
+
+            for (auto&& path : without_good_replica) {
+                log::rule_engine::warn("Skipping data object without a good replica [path={}]", path);
+                skipped.push_back(path);
+            }
+
+            return entries;
+        }
+
+        // The state of a data object in the destination tree of an interrupted snapshot.
+        struct destination_object
+        {
+            // The (resource id, physical path) of every replica.
+            std::vector<std::pair<std::string, std::string>> replicas;
+
+            // The resources of the replicas that carry hard link metadata.
+            std::set<std::string> linked_resource_ids;
+        };
+
+        // Lists every data object under the collection with two queries, so that resuming a
+        // snapshot does not need a lookup per data object.
+        auto list_destination_objects(rsComm_t& conn, const fs::path& collection) -> std::map<std::string, destination_object>
+        {
+            const auto condition = util::make_collection_tree_condition(collection);
+
+            std::map<std::string, destination_object> objects;
+
+            for (auto&& row : trace::query{&conn, fmt::format("select COLL_NAME, DATA_NAME, RESC_ID, DATA_PATH where {}", condition)}) {
+                if (util::is_in_collection_tree(collection, row[0])) {
+                    objects[util::make_logical_path(row[0], row[1])].replicas.emplace_back(std::move(row[2]), std::move(row[3]));
+                }
+            }
+
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, META_DATA_ATTR_UNITS "
+                                         "where META_DATA_ATTR_NAME = 'irods::hard_link' and {}", condition);
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                if (auto iter = objects.find(util::make_logical_path(row[0], row[1])); iter != std::end(objects)) {
+                    iter->second.linked_resource_ids.insert(std::move(row[2]));
+                }
+            }
+
+            return objects;
+        }
+
+        // Fills in the group id of every entry whose replica is already hard linked.
+        auto assign_group_ids(rsComm_t& conn, std::string_view condition, link_entry_map& entries) -> void
+        {
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, META_DATA_ATTR_VALUE, META_DATA_ATTR_UNITS "
+                                         "where META_DATA_ATTR_NAME = 'irods::hard_link' and {}", condition);
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                if (auto iter = entries.find(util::make_logical_path(row[0], row[1])); iter != std::end(entries)) {
+                    if (iter->second.replica.resource_id == row[3]) {
+                        iter->second.uuid = std::move(row[2]);
+                    }
+                }
+            }
+        }
+
+        // Registers a hard link to the entry's replica and adds the change to "changes". The parent
+        // collection's mtime is not updated. Callers are expected to update it once after all links have
+        // been created, and to publish the events once per batch of links.
+        //
+        // The link's metadata is written last, so a link that carries it is complete. A link that was
+        // registered by an interrupted operation (i.e. "registered" is true) is completed without
+        // registering it again.
+        auto link(rsComm_t& conn,
+                  const fs::path& source,
+                  link_entry& e,
+                  const fs::path& link_name,
+                  usage::batch& usage_batch,
+                  events::batch& changes,
+                  bool registered = false) -> int
+        {
+            locking::scoped_lock lock{locking::group_locks(), locking::make_lock_key(e.replica.resource_id, e.replica.physical_path)};
+
+            const bool new_group = e.uuid.empty();
+
+            // Random (v4) UUIDs do not collide in practice, so the per-UUID catalog lookup
+            // performed by generate_new_uuid is skipped for bulk operations.
+            const auto uuid = new_group ? to_string(boost::uuids::random_generator{}()) : e.uuid;
+
+            if (!registered) {
+                if (const auto ec = util::register_replica(conn, e.replica, link_name.c_str(), uuid, false); ec < 0) {
+                    log::rule_engine::error("Could not make hard link [error_code={}, physical_path={}, link_name={}]",
+                                            ec, e.replica.physical_path, link_name.c_str());
+                    return ec;
+                }
+            }
+
+            const hard_link hl{uuid, e.replica.resource_id};
+            const auto md = util::make_hard_link_avu(hl.uuid, hl.resource_id);
+            const auto size = std::stoll(e.replica.data_size);
+
+            util::copy_permissions(conn, source, link_name);
+
+            if (new_group) {
+                trace::add_metadata(conn, source, md);
+            }
+
+            e.uuid = uuid;
+
+            trace::add_metadata(conn, link_name, md);
+
+            // The hard link is owned by the client that registered it.
+            auto link_info = e.replica;
+            link_info.owner_name = conn.clientUser.userName;
+            link_info.owner_zone = conn.clientUser.rodsZone;
+
+            const bool same_owner = link_info.owner_name == e.replica.owner_name && link_info.owner_zone == e.replica.owner_zone;
+
+            usage_batch.add(usage::make_resource_key(hl.resource_id), new_group ? size : 0, new_group ? 2 * size : size);
+
+            if (new_group) {
+                usage_batch.add(usage::make_owner_key(e.replica.owner_name, e.replica.owner_zone), size, size);
+                usage_batch.add(usage::make_owner_key(link_info.owner_name, link_info.owner_zone), same_owner ? 0 : size, size);
+            }
+            else {
+                const auto owned = usage::count_members_owned_by(conn, hl, link_info, 2);
+                usage_batch.add(usage::make_owner_key(link_info.owner_name, link_info.owner_zone), owned == 1 ? size : 0, size);
+            }
+
+            if (new_group) {
+                auto event = events::make_event(hl);
+                event["logical_path"] = source.c_str();
+                event["physical_path"] = e.replica.physical_path;
+                changes.add("group_created", std::move(event));
+            }
+
+            auto event = events::make_event(hl);
+            event["logical_path"] = link_name.c_str();
+            event["physical_path"] = e.replica.physical_path;
+            changes.add("member_added", std::move(event));
+
+            return 0;
+        }
+
+        // Returns true if every replica carries the hard link metadata of the group that shares its
+        // physical object. Only such data objects may be removed by a bulk operation.
+        auto is_hard_linked(rsComm_t& conn, const fs::path& logical_path, const std::vector<data_object_info>& replicas) -> bool
+        {
+            if (replicas.empty()) {
+                return false;
+            }
+
+            const auto groups = util::get_hard_links(conn, logical_path);
+
+            return std::all_of(std::begin(replicas), std::end(replicas), [&groups](const data_object_info& r) {
+                return std::any_of(std::begin(groups), std::end(groups), [&r](const hard_link& hl) {
+                    return hl.resource_id == r.resource_id;
+                });
+            });
+        }
+
+        // Removes a data object through the unlink API so that the hard link PEPs handle it like any
+        // other client request (i.e. hard linked replicas are unregistered, all others are deleted).
+        // Callers must check is_hard_linked first so that data is never deleted.
+        auto remove(rsComm_t& conn, const fs::path& logical_path) -> int
+        {
+            dataObjInp_t input{};
+            rstrcpy(input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            addKeyVal(&input.condInput, FORCE_FLAG_KW, "");
+
+            trace::scoped_call call{trace::call_kind::server_api_call,
+                                    trace::join(std::to_string(DATA_OBJ_UNLINK_AN), logical_path.string()),
+                                    {logical_path.c_str()}};
+
+            return call.result(irods::server_api_call(DATA_OBJ_UNLINK_AN, &conn, &input));
+        }
+
+        auto update_collection_mtimes(rsComm_t& conn, const std::set<std::string>& collections) -> void
+        {
+            const auto now = std::chrono::time_point_cast<fs::object_time_type::duration>(std::chrono::system_clock::now());
+
+            for (auto&& c : collections) {
+                try {
+                    fs::server::last_write_time(conn, c, now);
+                }
+                catch (const fs::filesystem_error& e) {
+                    log::rule_engine::error("Could not update the collection's mtime. [error_code={}, collection={}]",
+                                            e.code().value(), c);
+                }
+            }
+        }
+
+        // Points every member of the hard link group that still references the source resource
+        // at the physical object's new location and relabels its hard link metadata. Members are
+        // only relabeled after their replica has been updated, so an interrupted move can be
+        // resumed by calling this again.
+        //
+        // Returns the number of members that were updated.
+        auto move_hard_link_members(rsComm_t& conn,
+                                    admission::fanout& fanout,
+                                    const hard_link& hl,
+                                    const std::string& dst_resource_id,
+                                    const std::string& dst_resource_name,
+                                    const std::string& new_physical_path) -> std::int64_t
+        {
+            std::int64_t member_count = 0;
+            std::int64_t failed = 0;
+            int last_error = 0;
+
+            // Members are read from the catalog a page at a time, together with all of their
+            // replicas, so no member needs a lookup of its own and memory use does not grow with
+            // the size of the group. Relabeled members leave the group's source resource, which is
+            // why pages resume after the last data id seen.
+            std::string last_data_id = "0";
+
+            for (;;) {
+                const auto page = util::get_hard_link_member_page(conn, hl.uuid, hl.resource_id, last_data_id, config.member_page_size);
+
+                if (page.empty()) {
+                    break;
+                }
+
+                last_data_id = page.back().data_id;
+
+                for (auto&& member : page) {
+                    fanout.admit();
+                    ++member_count;
+
+                    const auto& path = member.logical_path;
+                    const auto on_resource = [&member](const std::string& resource_id) {
+                        return std::find_if(std::begin(member.replicas), std::end(member.replicas), [&resource_id](const data_object_info& r) {
+                            return r.resource_id == resource_id;
+                        });
+                    };
+
+                    // It is possible that some data objects in the hard link group have multiple replicas.
+                    // In this case, we must find the replica that is part of the hard link group and
+                    // update it. This should only update a single replica's physical path. A member without
+                    // a replica on the source resource has already been moved (e.g. the data object that
+                    // was the target of the phymv).
+                    if (const auto replica = on_resource(hl.resource_id); replica != std::end(member.replicas)) {
+                        log::rule_engine::debug("Replica info [replica_number={}, resource_id={}, physical_path={}]",
+                                                replica->replica_number, replica->resource_id, replica->physical_path);
+
+                        const auto ec = util::set_replica_info(conn,
+                                                               path,
+                                                               replica->replica_number,
+                                                               dst_resource_id,
+                                                               dst_resource_name,
+                                                               new_physical_path,
+                                                               hl.uuid);
+
+                        // The member keeps the metadata of the source resource, so that it is still found
+                        // when the move is resumed.
+                        if (ec < 0) {
+                            log::rule_engine::error("Could not update the physical path [error_code={}, data_object={}, replica_number={}]",
+                                                    ec, path.c_str(), replica->replica_number);
+                            ++failed;
+                            last_error = ec;
+                            continue;
+                        }
+                    }
+                    else if (on_resource(dst_resource_id) == std::end(member.replicas)) {
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not find replica information by resource id [data_object={}]", path.c_str()));
+                    }
+
+                    util::replace_hard_link_metadata(conn, path, hl, dst_resource_id);
+                }
+            }
+
+            // Callers leave their journal record uncommitted, so recovery finishes the move.
+            if (failed > 0) {
+                THROW(last_error, fmt::format("Could not move every hard link group member [UUID={}, resource_id={}, failed={}]",
+                                              hl.uuid, hl.resource_id, failed));
+            }
+
+            return member_count;
+        }
+
+        // The replica state of a hard link group, loaded before iphymv copies any data.
+        struct move_plan
+        {
+            hard_link group;
+
+            // The physical path of the group on its current resource.
+            std::string physical_path;
+
+            // Every member and the number of its replica on the group's resource. Members without
+            // such a replica have no replica number.
+            std::vector<std::pair<fs::path, std::optional<std::string>>> members;
+
+            // The ids of the members when the plan was made. A member joining, leaving or being
+            // replaced by another data object (which has a new id) changes the set.
+            std::set<std::string> member_ids;
+        };
+
+        auto get_member_ids(rsComm_t& conn, const hard_link& hl) -> std::set<std::string>
+        {
+            const auto gql = fmt::format("select DATA_ID "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}'",
+                                         hl.uuid, hl.resource_id);
+
+            std::set<std::string> ids;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                ids.insert(std::move(row[0]));
+            }
+
+            return ids;
+        }
+
+        // Loads the replica of every member of the group on the group's resource with a single query.
+        // The physical path is taken from "target" (the data object being moved). Returns the plan
+        // and, if the group cannot be moved as a whole, the reason.
+        auto load_move_plan(rsComm_t& conn, const hard_link& hl, const fs::path& target)
+            -> std::pair<move_plan, std::optional<std::string>>
+        {
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, DATA_REPL_NUM, DATA_PATH, RESC_ID, DATA_ID "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}'",
+                                         hl.uuid, hl.resource_id);
+
+            // Every replica of every member is returned. Only the replicas on the group's resource
+            // are part of the group.
+            std::map<std::string, std::optional<std::pair<std::string, std::string>>> replicas;
+            std::set<std::string> member_ids;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                auto& replica = replicas[util::make_logical_path(row[0], row[1])];
+                member_ids.insert(std::move(row[5]));
+
+                if (row[4] == hl.resource_id) {
+                    replica.emplace(std::move(row[2]), std::move(row[3]));
+                }
+            }
+
+            move_plan plan{hl, {}, {}, std::move(member_ids)};
+
+            if (const auto iter = replicas.find(target.c_str()); iter != std::end(replicas) && iter->second) {
+                plan.physical_path = iter->second->second;
+            }
+            else {
+                return {std::move(plan), fmt::format("The data object has no replica in the hard link group [data_object={}]", target.c_str())};
+            }
+
+            std::optional<std::string> error;
+
+            for (auto&& [path, replica] : replicas) {
+                if (!replica) {
+                    error = fmt::format("Could not find replica information by resource id [data_object={}]", path);
+                }
+                else if (replica->second != plan.physical_path) {
+                    error = fmt::format("Hard link group member references a different physical path "
+                                        "[data_object={}, physical_path={}, expected={}]",
+                                        path, replica->second, plan.physical_path);
+                }
+
+                plan.members.emplace_back(path, replica ? std::optional{replica->first} : std::nullopt);
+            }
+
+            return {std::move(plan), std::move(error)};
+        }
+
+        // Updates every member recorded in the plan without reading the group again. Members that
+        // joined the group after the plan was made are found by one query and moved like any other
+        // group. Returns the number of members updated.
+        auto apply_move_plan(rsComm_t& conn,
+                             admission::fanout& fanout,
+                             const move_plan& plan,
+                             const fs::path& moved,
+                             const std::string& dst_resource_id,
+                             const std::string& dst_resource_name,
+                             const std::string& new_physical_path) -> std::int64_t
+        {
+            std::int64_t member_count = 0;
+
+            for (auto&& [path, replica_number] : plan.members) {
+                fanout.admit();
+
+                // The data object that was moved already references the new physical object.
+                if (replica_number && path != moved) {
+                    const auto ec = util::set_replica_info(conn, path, *replica_number, dst_resource_id, dst_resource_name, new_physical_path, plan.group.uuid);
+
+                    // Members that could not be updated keep their metadata and are retried by
+                    // move_hard_link_members below.
+                    if (ec < 0) {
+                        log::rule_engine::error("Could not update the physical path [error_code={}, data_object={}, replica_number={}]",
+                                                ec, path.c_str(), *replica_number);
+                        continue;
+                    }
+                }
+
+                util::replace_hard_link_metadata(conn, path, plan.group, dst_resource_id);
+                ++member_count;
+            }
+
+            if (util::count_hard_link_members(conn, plan.group.uuid, plan.group.resource_id, 1) > 0) {
+                member_count += move_hard_link_members(conn, fanout, plan.group, dst_resource_id, dst_resource_name, new_physical_path);
+            }
+
+            return member_count;
+        }
+
+        struct group_removal_result
+        {
+            std::int64_t removed = 0;
+            std::int64_t failed = 0;
+        };
+
+        // Unregisters every member of the hard link group and removes its hard link metadata, then
+        // deletes the physical object through the one member left. The physical object is kept if
+        // any member could not be unregistered. Members that no longer reference the physical
+        // object only lose their metadata, so an interrupted removal can be resumed by calling
+        // this again.
+        auto remove_hard_link_group(rsComm_t& conn,
+                                    admission::fanout& fanout,
+                                    const hard_link& hl,
+                                    const std::string& physical_path) -> group_removal_result
+        {
+            group_removal_result result;
+            usage::batch counters;
+            std::set<std::string> owners;
+            std::set<std::string> collections;
+            std::optional<std::pair<fs::path, data_object_info>> keeper;
+            std::int64_t size = 0;
+
+            const auto md = util::make_hard_link_avu(hl.uuid, hl.resource_id);
+
+            const auto record_removed = [&](const fs::path& path, const data_object_info& replica) {
+                const auto owner_key = usage::make_owner_key(replica.owner_name, replica.owner_zone);
+                size = std::stoll(replica.data_size);
+                counters.add(usage::make_resource_key(hl.resource_id), 0, -size);
+                counters.add(owner_key, 0, -size);
+                owners.insert(owner_key);
+                collections.insert(path.parent_path().string());
+                ++result.removed;
+            };
+
+            // Each page lists the members with all of their replicas, so members need no lookups of
+            // their own. Members leave the group as they are processed, which is why pages resume
+            // after the last data id seen.
+            std::string last_data_id = "0";
+
+            for (;;) {
+                auto page = util::get_hard_link_member_page(conn, hl.uuid, hl.resource_id, last_data_id, config.member_page_size);
+
+                if (page.empty()) {
+                    break;
+                }
+
+                last_data_id = page.back().data_id;
+
+                for (auto&& member : page) {
+                    fanout.admit();
+
+                    const auto& path = member.logical_path;
+                    const auto replica = std::find_if(std::begin(member.replicas), std::end(member.replicas), [&hl](const data_object_info& r) {
+                        return r.resource_id == hl.resource_id;
+                    });
+                    const auto registered = replica != std::end(member.replicas) && replica->physical_path == physical_path;
+
+                    // The physical object is deleted through the first member still referencing it.
+                    if (registered && !keeper) {
+                        keeper.emplace(path, *replica);
+                        continue;
+                    }
+
+                    if (registered) {
+                        if (const auto ec = util::unregister_replica(conn, path, replica->replica_number, hl.uuid); ec < 0) {
+                            log::rule_engine::error("Could not unregister hard link [error_code={}, data_object={}, replica_number={}]",
+                                                    ec, path.c_str(), replica->replica_number);
+                            ++result.failed;
+                            continue;
+                        }
+
+                        record_removed(path, *replica);
+                    }
+
+                    // Unregistering the last replica removes the data object along with its metadata.
+                    // Only members that keep a replica still carry the group's AVU.
+                    if (!registered || member.replicas.size() > 1) {
+                        trace::remove_metadata(conn, path, md);
+                    }
+                }
+            }
+
+            if (keeper && result.failed == 0) {
+                const auto& [path, replica] = *keeper;
+
+                trace::remove_metadata(conn, path, md);
+
+                if (const auto ec = util::unlink_replica(conn, path, replica.replica_number, hl.uuid); ec < 0) {
+                    THROW(ec, fmt::format("Could not unlink replica [data_object={}, replica_number={}]",
+                                          path.c_str(), replica.replica_number));
+                }
+
+                record_removed(path, replica);
+
+                counters.add(usage::make_resource_key(hl.resource_id), -size, 0);
+
+                for (auto&& owner_key : owners) {
+                    counters.add(owner_key, -size, 0);
+                }
+            }
+            else if (keeper) {
+                log::rule_engine::warn("Kept the physical object of a partially removed hard link group "
+                                       "[UUID={}, resource_id={}, remaining_members={}]",
+                                       hl.uuid, hl.resource_id, result.failed + 1);
+            }
+
+            counters.flush(conn);
+            update_collection_mtimes(conn, collections);
+
+            return result;
+        }
+    } // namespace bulk
+
+    //
+    // Operation Journal
+    //
+
+    namespace journal
+    {
+        // Returns the start time of the process in clock ticks since boot (field 22 of
+        // /proc/<pid>/stat). Together with the pid, it identifies a process even after its pid
+        // has been reused.
+        auto get_process_start_time(pid_t pid) -> std::optional<std::uint64_t>
+        {
+            std::ifstream in{fmt::format("/proc/{}/stat", pid)};
+            std::string stat;
+
+            if (!std::getline(in, stat)) {
+                return std::nullopt;
+            }
+
+            // The command name (field 2) may contain spaces and parentheses, so fields are
+            // counted from the last closing parenthesis.
+            const auto pos = stat.rfind(')');
+
+            if (pos == std::string::npos) {
+                return std::nullopt;
+            }
+
+            std::istringstream fields{stat.substr(pos + 1)};
+            std::string field;
+
+            for (int i = 3; i <= 22; ++i) {
+                if (!(fields >> field)) {
+                    return std::nullopt;
+                }
+            }
+
+            try {
+                return std::stoull(field);
+            }
+            catch (const std::exception&) {
+                return std::nullopt;
+            }
+        }
+
+        // A write-ahead record of a multi-step hard link operation. The intent is flushed to disk
+        // before the operation modifies the catalog, and each completed step is appended as it
+        // happens. Committing removes the record. Records left behind by an agent that no longer
+        // exists describe interrupted operations, which "hard_links_recover" rolls forward or back.
+        //
+        // Records are stored as JSON lines. The first line holds the intent and every following
+        // line names a completed step.
+        //
+        // Only the intent is flushed. Steps are written without flushing: they survive the death
+        // of the agent, and a step lost to a crash of the host only makes recovery check the
+        // catalog (or roll back a link that was complete), which is safe either way.
+        class entry
+        {
+        public:
+            entry(std::string_view operation, std::string_view lock_key, json intent)
+            {
+                if (config.journal_directory.empty()) {
+                    return;
+                }
+
+                if (mkdir(config.journal_directory.c_str(), S_IRWXU) == -1 && errno != EEXIST) {
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not create journal directory [path={}, errno={}]",
+                                                        config.journal_directory, errno));
+                }
+
+                // A record left behind by an earlier agent with the same pid must not be overwritten.
+                static std::uint64_t sequence = 0;
+
+                do {
+                    path_ = fmt::format("{}/{}.{}.journal", config.journal_directory, getpid(), sequence++);
+                    fd_ = open(path_.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+                } while (fd_ == -1 && errno == EEXIST);
+
+                if (fd_ == -1) {
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not create journal record [path={}, errno={}]", path_, errno));
+                }
+
+                json header{{"operation", operation}, {"lock_key", lock_key}, {"pid", getpid()}, {"intent", std::move(intent)}};
+
+                if (const auto start_time = get_process_start_time(getpid()); start_time) {
+                    header["start_time"] = *start_time;
+                }
+
+                append(header);
+
+                if (fdatasync(fd_) == -1) {
+                    const auto error = errno;
+                    commit();
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not flush journal record [path={}, errno={}]", path_, error));
+                }
+
+                // The record is only durable once the directory entry pointing to it is.
+                const int dir_fd = open(config.journal_directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+                if (dir_fd == -1 || fsync(dir_fd) == -1) {
+                    const auto error = errno;
+
+                    if (dir_fd != -1) {
+                        close(dir_fd);
+                    }
+
+                    // The operation has not started, so the record must not be recovered.
+                    commit();
+
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not flush journal directory [path={}, errno={}]",
+                                                        config.journal_directory, error));
+                }
+
+                close(dir_fd);
+            }
+
+            ~entry()
+            {
+                if (fd_ != -1) {
+                    close(fd_);
+                }
+            }
+
+            entry(const entry&) = delete;
+            auto operator=(const entry&) -> entry& = delete;
+
+            auto step(std::string_view name) -> void
+            {
+                append({{"step", name}});
+            }
+
+            // Marks the operation as finished. Also used when an operation fails before modifying
+            // the catalog, because there is nothing to recover in that case either.
+            auto commit() noexcept -> void
+            {
+                if (fd_ == -1) {
+                    return;
+                }
+
+                close(fd_);
+                fd_ = -1;
+
+                if (unlink(path_.c_str()) == -1) {
+                    log::rule_engine::error("Could not remove journal record [path={}, errno={}]", path_, errno);
+                }
+            }
+
+        private:
+            auto append(const json& record) -> void
+            {
+                if (fd_ == -1) {
+                    return;
+                }
+
+                const auto line = record.dump() + '\n';
+
+                for (std::size_t written = 0; written < line.size();) {
+                    if (const auto n = write(fd_, line.data() + written, line.size() - written); n >= 0) {
+                        written += n;
+                    }
+                    else if (errno != EINTR) {
+                        THROW(SYS_INTERNAL_ERR, fmt::format("Could not write journal record [path={}, errno={}]", path_, errno));
+                    }
+                }
+            }
+
+            std::string path_;
+            int fd_ = -1;
+        }; // class entry
+
+        struct record
+        {
+            json header;
+            std::set<std::string> steps;
+        };
+
+        auto read_record(const std::string& path) -> std::optional<record>
+        {
+            std::ifstream in{path};
+            std::string line;
+
+            if (!std::getline(in, line)) {
+                return std::nullopt;
+            }
+
+            record r;
+
+            // A header that cannot be parsed was never flushed completely, which means the
+            // operation did not get as far as modifying the catalog.
+            try {
+                r.header = json::parse(line);
+            }
+            catch (const json::exception&) {
+                return std::nullopt;
+            }
+
+            // Likewise, a partially written step was never completed.
+            while (std::getline(in, line)) {
+                try {
+                    r.steps.insert(json::parse(line).at("step").get<std::string>());
+                }
+                catch (const json::exception&) {
+                    break;
+                }
+            }
+
+            return r;
+        }
+
+        // The record may belong to an operation that is still running. A process with the same pid
+        // but a different start time reused the pid of the agent that wrote the record.
+        auto is_agent_alive(const json& header) -> bool
+        {
+            const auto pid = header.at("pid").get<pid_t>();
+
+            if (const auto iter = header.find("start_time"); iter != std::end(header)) {
+                const auto start_time = get_process_start_time(pid);
+                return start_time && *start_time == iter->get<std::uint64_t>();
+            }
+
+            // Records written without a start time can only be checked by pid.
+            return kill(pid, 0) == 0 || errno == EPERM;
+        }
+
+        auto remove_hard_link_metadata(rsComm_t& conn, const fs::path& p, const hard_link& hl) -> void
+        {
+            for (auto&& e : util::get_hard_links(conn, p)) {
+                if (e.uuid == hl.uuid && e.resource_id == hl.resource_id) {
+                    trace::remove_metadata(conn, p, util::make_hard_link_avu(hl.uuid, hl.resource_id));
+                    return;
+                }
+            }
+        }
+
+        // Returns "rolled_forward" or "rolled_back".
+        auto recover_create(rsComm_t& conn, const json& intent, const std::set<std::string>& steps) -> std::string
+        {
+            const fs::path source = intent.at("source").get<std::string>();
+            const fs::path link_name = intent.at("link_name").get<std::string>();
+            const hard_link hl{intent.at("uuid").get<std::string>(), intent.at("resource_id").get<std::string>()};
+
+            // Both data objects carry the hard link metadata. Only the permissions may be missing.
+            if (steps.count("linked") > 0) {
+                util::copy_permissions(conn, source, link_name);
+                return "rolled_forward";
+            }
+
+            // Otherwise, undo whatever part of the registration made it into the catalog.
+            remove_hard_link_metadata(conn, link_name, hl);
+
+            if (const auto replica = util::find_replica(conn, link_name, hl.resource_id);
+                replica && replica->physical_path == intent.at("physical_path").get_ref<const std::string&>())
+            {
+                if (const auto ec = util::unregister_replica(conn, link_name, replica->replica_number, hl.uuid); ec < 0) {
+                    THROW(ec, fmt::format("Could not unregister hard link [link_name={}]", link_name.c_str()));
+                }
+            }
+
+            if (intent.at("new_group").get<bool>()) {
+                remove_hard_link_metadata(conn, source, hl);
+            }
+
+            return "rolled_back";
+        }
+
+        auto recover_remove(rsComm_t& conn, const json& intent, const std::set<std::string>& steps) -> std::string
+        {
+            const fs::path logical_path = intent.at("logical_path").get<std::string>();
+            const hard_link hl{intent.at("uuid").get<std::string>(), intent.at("resource_id").get<std::string>()};
+
+            // The replica is still registered, so nothing happened.
+            if (steps.count("unregistered") == 0) {
+                if (const auto replica = util::find_replica(conn, logical_path, hl.resource_id);
+                    replica && replica->physical_path == intent.at("physical_path").get_ref<const std::string&>())
+                {
+                    return "rolled_back";
+                }
+            }
+
+            remove_hard_link_metadata(conn, logical_path, hl);
+
+            if (const auto last_member = util::get_sole_hard_link_member(conn, hl.uuid, hl.resource_id); last_member) {
+                remove_hard_link_metadata(conn, *last_member, hl);
+            }
+
+            return "rolled_forward";
+        }
+
+        auto recover_move(rsComm_t& conn, admission::fanout& fanout, const json& intent) -> std::string
+        {
+            const hard_link hl{intent.at("uuid").get<std::string>(), intent.at("src_resource_id").get<std::string>()};
+
+            bulk::move_hard_link_members(conn,
+                                         fanout,
+                                         hl,
+                                         intent.at("dst_resource_id").get<std::string>(),
+                                         intent.at("dst_resource_name").get<std::string>(),
+                                         intent.at("physical_path").get<std::string>());
+
+            return "rolled_forward";
+        }
+
+        auto recover_migrate(rsComm_t& conn, admission::fanout& fanout, const json& intent) -> std::string
+        {
+            const fs::path logical_path = intent.at("logical_path").get<std::string>();
+            const hard_link hl{intent.at("uuid").get<std::string>(), intent.at("src_resource_id").get<std::string>()};
+            const auto& dst_resource_id = intent.at("dst_resource_id").get_ref<const std::string&>();
+
+            // The replica never left the source resource, so the group is untouched.
+            if (util::find_replica(conn, logical_path, hl.resource_id)) {
+                return "rolled_back";
+            }
+
+            const auto replica = util::find_replica(conn, logical_path, dst_resource_id);
+
+            if (!replica) {
+                THROW(SYS_INTERNAL_ERR, fmt::format("Could not find the migrated replica [data_object={}]", logical_path.c_str()));
+            }
+
+            const auto member_count = bulk::move_hard_link_members(conn,
+                                                                   fanout,
+                                                                   hl,
+                                                                   dst_resource_id,
+                                                                   intent.at("dst_resource_name").get<std::string>(),
+                                                                   replica->physical_path);
+
+            // A migration publishes its events once per page of groups, so the agent may have died
+            // before publishing this group's event. Consumers may therefore see it twice.
+            events::batch changes;
+            auto e = events::make_event({hl.uuid, dst_resource_id});
+            e["previous_resource_id"] = hl.resource_id;
+            e["physical_path"] = replica->physical_path;
+            e["member_count"] = member_count;
+            changes.add("group_repointed", std::move(e));
+            changes.publish();
+
+            return "rolled_forward";
+        }
+
+        auto recover_remove_group(rsComm_t& conn, admission::fanout& fanout, const json& intent) -> std::string
+        {
+            const hard_link hl{intent.at("uuid").get<std::string>(), intent.at("resource_id").get<std::string>()};
+
+            if (const auto result = bulk::remove_hard_link_group(conn, fanout, hl, intent.at("physical_path").get<std::string>()); result.failed > 0) {
+                THROW(SYS_INTERNAL_ERR, fmt::format("Could not unregister every hard link [UUID={}, resource_id={}, failed={}]",
+                                                    hl.uuid, hl.resource_id, result.failed));
+            }
+
+            return "rolled_forward";
+        }
+
+        // Resolves every interrupted operation found in the journal directory.
+        auto recover(rsComm_t& conn) -> json
+        {
+            json result{{"rolled_forward", 0}, {"rolled_back", 0}, {"in_progress", 0}, {"failed", 0}};
+
+            if (config.journal_directory.empty() || !boost::filesystem::is_directory(config.journal_directory)) {
+                return result;
+            }
+
+            const auto increment = [&result](const std::string& counter) {
+                result[counter] = result[counter].get<std::int64_t>() + 1;
+            };
+
+            for (auto&& de : boost::filesystem::directory_iterator{config.journal_directory}) {
+                if (de.path().extension() != ".journal") {
+                    continue;
+                }
+
+                const auto path = de.path().string();
+
+                try {
+                    const auto r = read_record(path);
+
+                    if (r) {
+                        if (is_agent_alive(r->header)) {
+                            increment("in_progress");
+                            continue;
+                        }
+
+                        const auto& operation = r->header.at("operation").get_ref<const std::string&>();
+                        const auto& intent = r->header.at("intent");
+                        std::string outcome;
+
+                        // Operations that update a whole group reserve a fan-out slot before taking the
+                        // group lock. The size of the group is not worth a query here.
+                        const auto fans_out = (operation == "move" || operation == "migrate" || operation == "remove_group");
+                        admission::fanout fanout{fans_out ? std::numeric_limits<std::uintmax_t>::max() : 0};
+
+                        std::optional<locking::scoped_lock> lock;
+
+                        if (const auto& key = r->header.at("lock_key").get_ref<const std::string&>(); !key.empty()) {
+                            lock.emplace(locking::group_locks(), key);
+                        }
+
+                        if (operation == "create") {
+                            outcome = recover_create(conn, intent, r->steps);
+                        }
+                        else if (operation == "remove") {
+                            outcome = recover_remove(conn, intent, r->steps);
+                        }
+                        else if (operation == "move") {
+                            outcome = recover_move(conn, fanout, intent);
+                        }
+                        else if (operation == "migrate") {
+                            outcome = recover_migrate(conn, fanout, intent);
+                        }
+                        else if (operation == "remove_group") {
+                            outcome = recover_remove_group(conn, fanout, intent);
+                        }
+                        else {
+                            THROW(SYS_INTERNAL_ERR, fmt::format("Unknown journal operation [operation={}]", operation));
+                        }
+
+                        log::rule_engine::info("Recovered hard link operation [path={}, operation={}, outcome={}]", path, operation, outcome);
+                        increment(outcome);
+                    }
+
+                    boost::filesystem::remove(de.path());
+                }
+                catch (const irods::exception& e) {
+                    log::rule_engine::error("Could not recover hard link operation [path={}, error_code={}, error_message={}]",
+                                            path, e.code(), e.what());
+                    increment("failed");
+                }
+                catch (const std::exception& e) {
+                    log::rule_engine::error("Could not recover hard link operation [path={}, error_message={}]", path, e.what());
+                    increment("failed");
+                }
+            }
+
+            return result;
+        }
+    } // namespace journal
+
+    //
+    // Resource Migration
+    //
+
+    namespace migration
+    {
+        // Each shard can be migrated (or verified) by a separate agent. Groups are assigned to a
+        // shard by a hash of their full UUID, so any number of shards receive an even share.
+        // GenQuery cannot compute the hash, so every agent reads the list of groups and skips the
+        // groups of other shards.
+        auto is_in_shard(std::string_view uuid, std::size_t shard_index, std::size_t shard_count) noexcept -> bool
+        {
+            return shard_count == 1 || util::hash(uuid) % shard_count == shard_index;
+        }
+
+        // Moves the physical object of the hard link group to the destination resource (once) and
+        // points every member at it. Returns the number of members in the group.
+        //
+        // The usage and event changes are added to the batches and the journal record is appended
+        // to "entries", so that the caller can write them once per page of groups. The caller must
+        // publish the events before committing the records. If the group cannot be migrated, its
+        // record is left uncommitted and is not appended.
+        auto migrate_group(rsComm_t& conn,
+                           const hard_link& hl,
+                           const std::string& src_resource_name,
+                           const std::string& dst_resource_id,
+                           const std::string& dst_resource_name,
+                           usage::batch& counters,
+                           events::batch& changes,
+                           std::deque<journal::entry>& entries) -> std::int64_t
+        {
+            std::optional<data_object_info> replica;
+            fs::path representative;
+
+            for (auto&& path : util::hard_link_member_range{conn, hl.uuid, hl.resource_id, 1}) {
+                representative = path;
+                replica = util::find_replica(conn, path, hl.resource_id);
+                break;
+            }
+
+            if (!replica) {
+                THROW(SYS_INTERNAL_ERR, fmt::format("Could not find a replica of the hard link group on the source resource "
+                                                    "[UUID={}, resource_id={}]", hl.uuid, hl.resource_id));
+            }
+
+            // Sized before the group lock is taken (see admission::fanout).
+            const auto chunk_size = std::max<std::uintmax_t>(config.fanout_chunk_size, 1);
+            admission::fanout fanout{static_cast<std::uintmax_t>(util::count_hard_link_members(conn, hl.uuid, hl.resource_id, chunk_size + 1))};
+
+            const auto lock_key = locking::make_lock_key(hl.resource_id, replica->physical_path);
+            locking::scoped_lock lock{locking::group_locks(), lock_key};
+
+            auto& entry = entries.emplace_back("migrate", lock_key, json{
+                {"logical_path", representative.string()},
+                {"uuid", hl.uuid},
+                {"src_resource_id", hl.resource_id},
+                {"dst_resource_id", dst_resource_id},
+                {"dst_resource_name", dst_resource_name}
+            });
+
+            try {
+                if (const auto ec = util::move_replica(conn, representative, replica->replica_number, src_resource_name, dst_resource_name, hl.uuid); ec < 0) {
+                    entry.commit();
+                    THROW(ec, fmt::format("Could not move replica [data_object={}, replica_number={}]",
+                                          representative.c_str(), replica->replica_number));
+                }
+
+                entry.step("moved");
+
+                const auto new_replica = util::find_replica(conn, representative, dst_resource_id);
+
+                if (!new_replica) {
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not find the migrated replica [data_object={}]", representative.c_str()));
+                }
+
+                const auto member_count = bulk::move_hard_link_members(conn, fanout, hl, dst_resource_id, dst_resource_name, new_replica->physical_path);
+
+                usage::record_group_moved(counters, hl.resource_id, dst_resource_id, std::stoll(new_replica->data_size), member_count);
+
+                auto e = events::make_event({hl.uuid, dst_resource_id});
+                e["previous_resource_id"] = hl.resource_id;
+                e["physical_path"] = new_replica->physical_path;
+                e["member_count"] = member_count;
+                changes.add("group_repointed", std::move(e));
+
+                return member_count;
+            }
+            catch (...) {
+                // Closes the record without committing it (unless the replica was never moved), so
+                // that recovery finishes the migration.
+                entries.pop_back();
+                throw;
+            }
+        }
+    } // namespace migration
+
+    //
+    // Fixity
+    //
+
+    namespace fixity
+    {
+        constexpr const char* verification_attribute = "irods::hard_link::verified";
+
+        struct member
+        {
+            fs::path logical_path;
+            std::string data_size;
+            std::string checksum;
+        };
+
+        struct summary
+        {
+            std::int64_t groups = 0;
+            std::int64_t physical_objects = 0;
+            std::int64_t members = 0;
+            std::int64_t failed = 0;
+            std::map<std::string, std::int64_t> statuses;
+            json problems = json::array();
+        };
+
+        // The number of problems listed in the output. The worst problem of each group is recorded
+        // on its resource.
+        constexpr std::size_t max_problems_reported = 100;
+
+        // Returns the members of the group, grouped by the physical path of their replica on the
+        // group's resource. A healthy group has a single physical path. All members are read with
+        // one query.
+        auto load_group(rsComm_t& conn, const hard_link& hl) -> std::map<std::string, std::vector<member>>
+        {
+            const auto gql = fmt::format("select COLL_NAME, DATA_NAME, DATA_PATH, DATA_SIZE, DATA_CHECKSUM, RESC_ID "
+                                         "where"
+                                         " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                         " META_DATA_ATTR_VALUE = '{}' and"
+                                         " META_DATA_ATTR_UNITS = '{}'",
+                                         hl.uuid, hl.resource_id);
+
+            std::map<std::string, std::vector<member>> physical_objects;
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                // Replicas on other resources are not part of the group.
+                if (row[5] == hl.resource_id) {
+                    physical_objects[row[2]].push_back({util::make_logical_path(row[0], row[1]), std::move(row[3]), std::move(row[4])});
+                }
+            }
+
+            return physical_objects;
+        }
+
+        auto resolve_hierarchy(const std::string& resource_id) -> std::string
+        {
+            std::string hier;
+
+            if (const auto err = resc_mgr.leaf_id_to_hier(std::stoll(resource_id), hier); !err.ok()) {
+                THROW(err.code(), fmt::format("Could not resolve resource id to hierarchy [resource_id={}]", resource_id));
+            }
+
+            return hier;
+        }
+
+        // Returns the size of the physical object, or nothing if it does not exist. The request is
+        // redirected to the server hosting the resource.
+        auto stat_physical_object(rsComm_t& conn,
+                                  const std::string& hier,
+                                  const std::string& resource_id,
+                                  const std::string& physical_path,
+                                  const fs::path& logical_path,
+                                  const std::string& group) -> std::optional<rodsLong_t>
+        {
+            fileStatInp_t input{};
+            rstrcpy(input.fileName, physical_path.c_str(), MAX_NAME_LEN);
+            rstrcpy(input.rescHier, hier.c_str(), MAX_NAME_LEN);
+            rstrcpy(input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            input.rescId = std::stoll(resource_id);
+
+            trace::scoped_call call{trace::call_kind::file_stat,
+                                    trace::join(logical_path.string(), physical_path, hier),
+                                    {logical_path.c_str(), group.c_str()}};
+
+            rodsStat_t* stat{};
+            const auto ec = call.result(rsFileStat(&conn, &input, &stat));
+            const auto size = stat ? std::optional{stat->st_size} : std::nullopt;
+            std::free(stat);
+
+            if (ec < 0) {
+                if (getErrno(ec) == ENOENT) {
+                    return std::nullopt;
+                }
+
+                THROW(ec, fmt::format("Could not stat physical object [physical_path={}, resource_hierarchy={}]", physical_path, hier));
+            }
+
+            return size;
+        }
+
+        // Computes the checksum of the physical object on the server hosting the resource. The
+        // scheme of "registered_checksum" is used, so the result can be compared with it.
+        auto compute_checksum(rsComm_t& conn,
+                              const std::string& hier,
+                              const std::string& physical_path,
+                              const fs::path& logical_path,
+                              const std::string& registered_checksum,
+                              rodsLong_t size,
+                              const std::string& group) -> std::string
+        {
+            fileChksumInp_t input{};
+            rstrcpy(input.fileName, physical_path.c_str(), MAX_NAME_LEN);
+            rstrcpy(input.rescHier, hier.c_str(), MAX_NAME_LEN);
+            rstrcpy(input.objPath, logical_path.c_str(), MAX_NAME_LEN);
+            rstrcpy(input.orig_chksum, registered_checksum.c_str(), NAME_LEN);
+            input.dataSize = size;
+
+            trace::scoped_call call{trace::call_kind::file_chksum,
+                                    trace::join(logical_path.string(), physical_path, hier),
+                                    {logical_path.c_str(), group.c_str()}};
+
+            char* checksum{};
+
+            if (const auto ec = call.result(rsFileChksum(&conn, &input, &checksum)); ec < 0) {
+                std::free(checksum);
+                THROW(ec, fmt::format("Could not compute checksum [physical_path={}, resource_hierarchy={}]", physical_path, hier));
+            }
+
+            std::string result = checksum ? checksum : "";
+            std::free(checksum);
+
+            return result;
+        }
+
+        // The statuses of a verification, from best to worst.
+        constexpr std::array<std::string_view, 4> statuses{"ok", "checksum_mismatch", "size_mismatch", "missing"};
+
+        // Reads and (optionally) hashes each physical object of the group once, then records the
+        // outcome of the group on its resource as "irods::hard_link::verified" (value: UUID, units:
+        // "<status>:<time of the verification in seconds since the Unix epoch>"). The status is the
+        // worst one found among the members: "ok", "checksum_mismatch", "size_mismatch" or
+        // "missing". The group's previous result is replaced in a single catalog transaction.
+        auto verify_group(rsComm_t& conn, const hard_link& hl, bool verify_checksum, summary& s) -> void
+        {
+            const auto hier = resolve_hierarchy(hl.resource_id);
+            const auto now = std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+
+            const auto physical_objects = load_group(conn, hl);
+
+            // The group was dissolved after it was listed.
+            if (physical_objects.empty()) {
+                return;
+            }
+
+            std::size_t worst = 0;
+
+            for (auto&& [physical_path, members] : physical_objects) {
+                ++s.physical_objects;
+
+                const auto size = stat_physical_object(conn, hier, hl.resource_id, physical_path, members.front().logical_path, hl.uuid);
+
+                // Members normally share a registered checksum. Each distinct scheme is computed once.
+                std::map<std::string, std::string> checksums;
+
+                if (size && verify_checksum) {
+                    for (auto&& m : members) {
+                        if (m.checksum.empty()) {
+                            continue;
+                        }
+
+                        const auto scheme = m.checksum.substr(0, m.checksum.find(':') + 1);
+
+                        if (checksums.count(scheme) == 0) {
+                            checksums[scheme] = compute_checksum(conn, hier, physical_path, m.logical_path, m.checksum, *size, hl.uuid);
+                        }
+                    }
+                }
+
+                for (auto&& m : members) {
+                    std::size_t status = 0;
+
+                    if (!size) {
+                        status = 3;
+                    }
+                    else if (std::to_string(*size) != m.data_size) {
+                        status = 2;
+                    }
+                    else if (verify_checksum && !m.checksum.empty() &&
+                             checksums[m.checksum.substr(0, m.checksum.find(':') + 1)] != m.checksum)
+                    {
+                        status = 1;
+                    }
+
+                    ++s.members;
+                    ++s.statuses[std::string{statuses[status]}];
+                    worst = std::max(worst, status);
+
+                    if (status != 0 && s.problems.size() < max_problems_reported) {
+                        s.problems.push_back({
+                            {"logical_path", m.logical_path.c_str()},
+                            {"physical_path", physical_path},
+                            {"status", std::string{statuses[status]}}
+                        });
+                    }
+                }
+            }
+
+            // The leaf resource is the last element of the hierarchy.
+            const fs::path resource_name = hier.substr(hier.rfind(';') + 1);
+
+            const auto gql = fmt::format("select META_RESC_ATTR_UNITS "
+                                         "where"
+                                         " RESC_ID = '{}' and"
+                                         " META_RESC_ATTR_NAME = '{}' and"
+                                         " META_RESC_ATTR_VALUE = '{}'",
+                                         hl.resource_id, verification_attribute, hl.uuid);
+
+            auto operations = json::array();
+
+            for (auto&& row : trace::query{&conn, gql}) {
+                operations.push_back({
+                    {"operation", "remove"},
+                    {"attribute", verification_attribute},
+                    {"value", hl.uuid},
+                    {"units", std::move(row[0])}
+                });
+            }
+
+            operations.push_back({
+                {"operation", "add"},
+                {"attribute", verification_attribute},
+                {"value", hl.uuid},
+                {"units", fmt::format("{}:{}", statuses[worst], now)}
+            });
+
+            try {
+                ix::scoped_privileged_client spc{conn};
+                trace::apply_metadata_operations(conn, resource_name, std::move(operations), "resource");
+            }
+            catch (const irods::exception& e) {
+                log::rule_engine::error("Could not record verification result [error_code={}, UUID={}, resource={}, status={}]",
+                                        e.code(), hl.uuid, resource_name.c_str(), statuses[worst]);
+                ++s.failed;
+            }
+        }
+    } // namespace fixity
+
+    //
+    // PEP Handlers
+    //
+
+    namespace handler
+    {
+        auto pep_api_data_obj_rename_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjCopyInp_t>(rule_arguments);
+
+                if (input->srcDataObjInp.oprType == RENAME_COLL) {
+                    // Hard linked data objects must not be moved to where the other handlers
+                    // no longer see them.
+                    if (!scope::contains(input->srcDataObjInp.objPath) ||
+                        scope::paths().contains_tree(input->destDataObjInp.objPath))
+                    {
+                        return CODE(RULE_ENGINE_CONTINUE);
+                    }
+
+                    auto& conn = *util::get_rei(effect_handler).rsComm;
+                    const fs::path collection = input->srcDataObjInp.objPath;
+                    const auto gql = fmt::format("select COLL_NAME where META_DATA_ATTR_NAME = 'irods::hard_link' and {}",
+                                                 util::make_collection_tree_condition(collection));
+
+                    for (auto&& row : trace::query{&conn, gql}) {
+                        if (util::is_in_collection_tree(collection, row[0])) {
+                            return ERROR(SYS_INVALID_INPUT_PARAM, "Hard linked data objects cannot be moved outside of the configured collections");
+                        }
+                    }
+
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                if (!scope::contains(input->srcDataObjInp.objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+                const fs::path src_path = input->srcDataObjInp.objPath;
+
+                // If the path is part of a hard link group, then update the logical path and
+                // skip the actual rename operation. Else, do nothing and continue to the next REP.
+                if (const auto hl_info = util::get_hard_links(conn, src_path); !hl_info.empty()) {
+                    const fs::path dst_path = input->destDataObjInp.objPath;
+
+                    if (!scope::contains(dst_path.c_str())) {
+                        return ERROR(SYS_INVALID_INPUT_PARAM, "Hard linked data objects cannot be moved outside of the configured collections");
+                    }
+
+                    // Do nothing if the paths are identical.
+                    if (src_path == dst_path) {
+                        return CODE(RULE_ENGINE_SKIP_OPERATION);
+                    }
+
+                    if (const auto ec = util::set_logical_path(conn, src_path, dst_path, hl_info.front().uuid); ec < 0) {
+                        const auto msg = fmt::format("Could not update logical path. Use iadmin modrepl to update the "
+                                                     "data object. [from={}, to={}]",
+                                                     src_path.c_str(),
+                                                     dst_path.c_str());
+                        log::rule_engine::error(msg);
+                        addRErrorMsg(&util::get_rei(effect_handler).rsComm->rError, ec, msg.data());
+                    }
+                    else {
+                        events::batch changes;
+
+                        for (auto&& hl : hl_info) {
+                            auto e = events::make_event(hl);
+                            e["from"] = src_path.c_str();
+                            e["to"] = dst_path.c_str();
+                            changes.add("member_renamed", std::move(e));
+                        }
+
+                        changes.publish();
+                    }
+
+                    util::update_collection_mtime(conn, src_path.parent_path(), fs::path{input->destDataObjInp.objPath}.parent_path());
+
+                    return CODE(RULE_ENGINE_SKIP_OPERATION);
+                }
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return CODE(RULE_ENGINE_CONTINUE);
+        }
+
+        auto pep_api_data_obj_unlink_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+
+                if (!scope::contains(input->objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+
+                // Determine which sibling hard link members needs to have their hard link metadata
+                // updated to reflect the fact that the specified data object will be deleted. Some
+                // replicas may be deleted while others remain because they are being referenced by
+                // other data objects.
+
+                const auto hl_info = util::get_hard_links(conn, input->objPath);
+
+                if (hl_info.empty()) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                // At this point, the data object to delete could be a member of multiple hard link groups.
+                // We must now partition the set of replicas into ones that will be deleted and ones that
+                // will be unregistered.
+
+                for (auto&& replica : util::get_replicas(conn, input->objPath)) {
+                    log::rule_engine::debug("Handling replica [resource_id={}, replica_number={}, physical_path={}]",
+                                            replica.resource_id, replica.replica_number, replica.physical_path);
+
+                    // If the replica is hard linked, then unregister the replica and remove the hard link
+                    // metadata from the data object that is being deleted.
+                    if (const auto object = util::find_hard_link(hl_info, replica.resource_id); object) {
+                        const hard_link& info = object.value();
+
+                        log::rule_engine::debug("Replica is hard linked. Unregistering replica ... "
+                                                "[replica_number={}, physical_path={}, UUID={}, resource_id={}]",
+                                                replica.replica_number, replica.physical_path, info.uuid, info.resource_id);
+
+                        const auto lock_key = locking::make_lock_key(replica.resource_id, replica.physical_path);
+                        locking::scoped_lock lock{locking::group_locks(), lock_key};
+
+                        journal::entry entry{"remove", lock_key, {
+                            {"logical_path", input->objPath},
+                            {"uuid", info.uuid},
+                            {"resource_id", info.resource_id},
+                            {"physical_path", replica.physical_path}
+                        }};
+
+                        if (const auto ec = util::unregister_replica(conn, input->objPath, replica.replica_number, info.uuid); ec < 0) {
+                            log::rule_engine::error("Could not remove hard link [{}]", input->objPath);
+                            entry.commit();
+                            return ERROR(ec, "Hard Link removal error");
+                        }
+
+                        entry.step("unregistered");
+
+                        try {
+                            const auto md = util::make_hard_link_avu(info.uuid, info.resource_id);
+
+                            if (fs::server::exists(conn, input->objPath)) {
+                                trace::remove_metadata(conn, input->objPath, md);
+                            }
+
+                            usage::record_member_removed(conn, info, replica);
+
+                            events::batch changes;
+                            auto e = events::make_event(info);
+                            e["logical_path"] = input->objPath;
+                            changes.add("member_unregistered", std::move(e));
+
+                            if (const auto last_member = util::get_sole_hard_link_member(conn, info.uuid, info.resource_id); last_member) {
+                                trace::remove_metadata(conn, *last_member, md);
+
+                                if (const auto last = util::find_replica(conn, *last_member, info.resource_id); last) {
+                                    usage::record_member_removed(conn, info, *last);
+                                }
+
+                                e = events::make_event(info);
+                                e["logical_path"] = last_member->c_str();
+                                changes.add("group_dissolved", std::move(e));
+                            }
+
+                            // Published before the record is committed, so a crash in between cannot
+                            // lose the events of a completed operation.
+                            changes.publish();
+                            entry.commit();
+                        }
+                        catch (const fs::filesystem_error& e) {
+                            log::rule_engine::error("Could not remove hard link metadata "
+                                                    "[error_code={}, error_message={}, data_object={}, replica_number={}, UUID={}, resource_id={}]",
+                                                    e.code().value(), e.what(), input->objPath, replica.replica_number, info.uuid, info.resource_id);
+                            // TODO Should this be a hard stop?
+                            return ERROR(e.code().value(), e.what());
+                        }
+                    }
+                    // If the replica is not hard linked, then simply unlink it.
+                    else {
+                        log::rule_engine::debug("Replica is NOT hard linked. Deleting replica ... [replica_number={}, physical_path={}]",
+                                                replica.replica_number, replica.physical_path);
+
+                        if (const auto ec = util::unlink_replica(conn, input->objPath, replica.replica_number); ec < 0) {
+                            log::rule_engine::error("Could not unlink replica [error_code={}, data_object={}, replica_number={}]",
+                                                    ec, input->objPath, replica.replica_number);
+                            return ERROR(ec, fmt::format("Could not unlink replica [data_object={}, replica_number={}",
+                                                         input->objPath, replica.replica_number));
+                        }
+                    }
+                }
+
+                util::update_collection_mtime(conn, fs::path{input->objPath}.parent_path());
+
+                return CODE(RULE_ENGINE_SKIP_OPERATION);
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return CODE(RULE_ENGINE_CONTINUE);
+        }
+
+        auto pep_api_data_obj_trim_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+
+                if (!scope::contains(input->objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+                const auto hl_info = util::get_hard_links(conn, input->objPath);
+                
+                if (hl_info.empty()) {
+                    log::rule_engine::debug("Data object is not part of a hard link group [data_object={}].", input->objPath);
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                ix::key_value_proxy kvp{input->condInput};
+
+                // TODO Add deprecation message for itrim -N (4-2-stable only)!
+
+                if (kvp.contains(RESC_NAME_KW) && // -S
+                    kvp.contains(REPL_NUM_KW))    // -n
+                {
+                    return ERROR(USER_INCOMPATIBLE_PARAMS, "Incompatible parameters: source resource name and replica number");
+                }
+
+                specCollCache_t* specCollCache = nullptr;
+                resolveLinkedPath(&conn, input->objPath, &specCollCache, &input->condInput);
+
+                rodsServerHost_t* rodsServerHost = nullptr;
+                
+                if (const auto ec = getAndConnRemoteZone(&conn, input, &rodsServerHost, REMOTE_OPEN); ec < 0) {
+                    return ERROR(ec, "Redirect error");
+                }
+                else if (ec == REMOTE_HOST) {
+                    const auto ec = rcDataObjTrim(rodsServerHost->conn, input);
+                    
+                    if (ec < 0) {
+                        return ERROR(ec, "Redirect error");
+                    }
+
+                    return CODE(ec);
+                }
+
+                int error_code = 0;
+                std::string replica_number;
+
+                // Temporarily remove REPL_NUM_KW to ensure we are returned all replicas in the list.
+                if (kvp.contains(REPL_NUM_KW)) {
+                    replica_number = kvp[REPL_NUM_KW].value().data();
+                    kvp.erase(REPL_NUM_KW);
+                }
+
+                const auto repl_list = util::get_replica_list(conn, *input);
+
+                if (!replica_number.empty()) {
+                    kvp[REPL_NUM_KW] = replica_number;
+                }
+
+                const auto is_dry_run = kvp.contains(DRYRUN_KW);
+
+                for (auto&& obj : util::get_list_of_replicas_to_trim(*input, repl_list)) {
+                    log::rule_engine::debug("Replica to trim [data_object={}, replica_number={}, physical_path={}]",
+                                            input->objPath, obj.repl_num(), obj.path());
+
+                    if (is_dry_run) {
+                        log::rule_engine::debug("This is a dry run. Skipping ...");
+                        error_code = 1;
+                        continue;
+                    }
+
+                    log::rule_engine::debug("Checking if replica is hard linked ...");
+
+                    if (const auto object = util::find_hard_link(hl_info, std::to_string(obj.resc_id())); object) {
+                        const hard_link& hl = object.value();
+
+                        log::rule_engine::debug("Unregistering replica. [UUID={}, resource_id={}]", hl.uuid, hl.resource_id);
+
+                        const auto lock_key = locking::make_lock_key(hl.resource_id, obj.path());
+                        locking::scoped_lock lock{locking::group_locks(), lock_key};
+
+                        journal::entry entry{"remove", lock_key, {
+                            {"logical_path", input->objPath},
+                            {"uuid", hl.uuid},
+                            {"resource_id", hl.resource_id},
+                            {"physical_path", obj.path()}
+                        }};
+
+                        if (const auto ec = util::unregister_replica(conn, input->objPath, std::to_string(obj.repl_num()), hl.uuid); ec < 0) {
+                            log::rule_engine::error("Could not unregister replica [data_object={}, replica_number={}]",
+                                                    input->objPath, obj.repl_num());
+                            entry.commit();
+                            return ERROR(ec, "Could not unregister replica");
+                        }
+
+                        entry.step("unregistered");
+
+                        try {
+                            const auto md = util::make_hard_link_avu(hl.uuid, hl.resource_id);
+
+                            // Because trimming a data object never deletes it, we must always remove any hard link
+                            // metadata associated with it.
+                            trace::remove_metadata(conn, input->objPath, md);
+
+                            usage::record_member_removed(conn, hl, {obj.path(), std::to_string(obj.repl_num()), obj.resc_name(),
+                                                                    hl.resource_id, std::to_string(obj.size()),
+                                                                    obj.owner_name(), obj.owner_zone()});
+
+                            events::batch changes;
+                            auto e = events::make_event(hl);
+                            e["logical_path"] = input->objPath;
+                            changes.add("member_unregistered", std::move(e));
+
+                            // Remove any hard link metadata that represents a hard link group of size one.
+                            // Hard links groups always have at least two data objects in them.
+                            if (const auto last_member = util::get_sole_hard_link_member(conn, hl.uuid, hl.resource_id); last_member) {
+                                trace::remove_metadata(conn, *last_member, md);
+
+                                if (const auto last = util::find_replica(conn, *last_member, hl.resource_id); last) {
+                                    usage::record_member_removed(conn, hl, *last);
+                                }
+
+                                e = events::make_event(hl);
+                                e["logical_path"] = last_member->c_str();
+                                changes.add("group_dissolved", std::move(e));
+                            }
+
+                            // Published before the record is committed, so a crash in between cannot
+                            // lose the events of a completed operation.
+                            changes.publish();
+                            entry.commit();
+                        }
+                        catch (const fs::filesystem_error& e) {
+                            log::rule_engine::error("Could not remove hard link metadata "
+                                                    "[error_code={}, error_message={}, data_object={}, replica_number={}, UUID={}, resource_id={}]",
+                                                    e.code().value(), e.what(), input->objPath, obj.repl_num(), hl.uuid, hl.resource_id);
+                            return ERROR(e.code().value(), e.what());
+                        }
+                    }
+                    else {
+                        log::rule_engine::debug("Unlinking replica ...");
+
+                        auto dobj_info = util::convert_physical_object_to_dataObjInfo_t(obj);
+
+                        // The replica is not part of a hard link group, so delete it.
+                        // The else-block is not making sense to me. It is basically saying that if the first
+                        // replica is successfully deleted, remember that success code and do not allow any failures
+                        // to be returned back to the client.
+                        if (const auto ec = dataObjUnlinkS(&conn, input, &dobj_info); ec < 0) {
+                            log::rule_engine::error("Could not unlink replica [error_code={}, data_object={}, replica_number={}]",
+                                                    ec, input->objPath, dobj_info.replNum);
+
+                            if (error_code == 0) {
+                                error_code = ec;
+                            }
+                        }
+                        else {
+                            error_code = 1;
+                        }
+                    }
+                }
+
+                return CODE(RULE_ENGINE_SKIP_OPERATION);
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return CODE(RULE_ENGINE_CONTINUE);
+        }
+
+        // Plans made by pep_api_data_obj_phymv_pre for the post handler of the same request. Both
+        // handlers run in the same agent, so the plan does not need to be shared.
+        auto move_plans() -> std::map<std::string, bulk::move_plan>&
+        {
+            static std::map<std::string, bulk::move_plan> plans;
+            return plans;
+        }
+
+        auto make_move_plan_key(const dataObjInp_t& input) -> std::string
+        {
+            const auto* src_resource = getValByKey(&input.condInput, RESC_NAME_KW);
+            const auto* dst_resource = getValByKey(&input.condInput, DEST_RESC_NAME_KW);
+
+            return fmt::format("{}\x1f{}\x1f{}", input.objPath, src_resource ? src_resource : "", dst_resource ? dst_resource : "");
+        }
+
+        // Checks that every member of the hard link group can be updated before any data is copied,
+        // so that a failure cannot leave the group split after an expensive transfer. The group's
+        // replica state is handed to the post handler.
+        auto pep_api_data_obj_phymv_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+
+                // An agent serves one request at a time, so any plan left over is stale.
+                move_plans().clear();
+
+                const auto key = make_move_plan_key(*input);
+
+                if (!scope::contains(input->objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                // Without a source resource, the post handler cannot tell which group is moved either.
+                const auto* src_resource_name = getValByKey(&input->condInput, RESC_NAME_KW);
+
+                if (!src_resource_name) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+
+                const auto hl_info = util::get_hard_links(conn, input->objPath);
+
+                if (hl_info.empty()) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                rodsLong_t src_resc_id;
+                util::resolve_resource(src_resource_name)->get_property(irods::RESOURCE_ID, src_resc_id);
+
+                const auto object = util::find_hard_link(hl_info, std::to_string(src_resc_id));
+
+                if (!object) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                // The plan is made under the group's lock, so no other operation on the group is
+                // halfway done while the members are read. The lock key is derived from the physical
+                // path of the data object being moved, which every member shares.
+                const auto replica = util::find_replica(conn, input->objPath, object->resource_id);
+
+                if (!replica) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                locking::scoped_lock lock{locking::group_locks(), locking::make_lock_key(object->resource_id, replica->physical_path)};
+
+                auto [plan, error] = bulk::load_move_plan(conn, *object, input->objPath);
+
+                if (!error && plan.physical_path != replica->physical_path) {
+                    error = fmt::format("The data object was moved concurrently [data_object={}]", input->objPath);
+                }
+
+                if (error) {
+                    log::rule_engine::error("Rejecting physical move of hard link group [UUID={}, resource_id={}, reason={}]",
+                                            object->uuid, object->resource_id, *error);
+                    return ERROR(SYS_INVALID_INPUT_PARAM, *error);
+                }
+
+                log::rule_engine::debug("Planned physical move of hard link group [UUID={}, resource_id={}, member_count={}]",
+                                        object->uuid, object->resource_id, plan.members.size());
+
+                move_plans().insert_or_assign(key, std::move(plan));
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return CODE(RULE_ENGINE_CONTINUE);
+        }
+
+        // Runs whether or not the move succeeded, so a plan is not left behind when the post handler
+        // never runs.
+        auto pep_api_data_obj_phymv_finally(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+                move_plans().erase(make_move_plan_key(*input));
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return CODE(RULE_ENGINE_CONTINUE);
+        }
+
+        auto pep_api_data_obj_phymv_post(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+
+                std::optional<bulk::move_plan> plan;
+
+                if (auto node = move_plans().extract(make_move_plan_key(*input)); node) {
+                    plan = std::move(node.mapped());
+                }
+
+                if (!scope::contains(input->objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+
+                if (!fs::server::is_data_object(conn, input->objPath)) {
+                    return CODE(RULE_ENGINE_CONTINUE);
+                }
+
+                const auto hl_info = util::get_hard_links(conn, input->objPath);
+
+                ix::key_value_proxy kvp{input->condInput};
+
+                auto src_resc = util::resolve_resource(kvp.at(RESC_NAME_KW).value());
+                rodsLong_t src_resc_id;
+                src_resc->get_property(irods::RESOURCE_ID, src_resc_id);
+                log::rule_engine::debug("Source resource id = {}", src_resc_id);
+
+                auto dst_resc = util::resolve_resource(kvp.at(DEST_RESC_NAME_KW).value());
+                rodsLong_t dst_resc_id;
+                dst_resc->get_property(irods::RESOURCE_ID, dst_resc_id);
+                log::rule_engine::debug("Destination resource id = {}", dst_resc_id);
+
+                std::string dst_resource_name;
+                dst_resc->get_property(irods::RESOURCE_NAME, dst_resource_name);
+                log::rule_engine::debug("Destination resource name = {}", dst_resource_name);
+
+                const auto src_resource_id = std::to_string(src_resc_id);
+
+                if (auto object = util::find_hard_link(hl_info, src_resource_id); object) {
+                    const hard_link& hl = object.value();
+
+                    log::rule_engine::debug("Found hard link information [UUID={}, resource_id={}]", hl.uuid, hl.resource_id);
+
+                    // Retrieve the replica information of the data object that was recently updated.
+                    const auto dst_resource_id = std::to_string(dst_resc_id);
+                    const auto new_replica = util::find_replica(conn, input->objPath, dst_resource_id);
+
+                    if (!new_replica) {
+                        THROW(SYS_INTERNAL_ERR, "Could not find replica information by resource id");
+                    }
 
-            return info;
-        }
+                    const auto& new_physical_path = new_replica->physical_path;
 
-        auto get_minimum_age_in_minutes(const ix::key_value_proxy<keyValPair_t>& _kvp) -> std::chrono::minutes
-        {
-            if (const auto iter = _kvp.find(AGE_KW); iter != std::end(_kvp)) {
-                if (const auto v = std::atoi((*iter).value().data()); v > 0) {
-                    return std::chrono::minutes{v};
-                }
-            }
+                    // The plan only applies to the group it was made for.
+                    if (plan && (plan->group.uuid != hl.uuid || plan->group.resource_id != hl.resource_id)) {
+                        plan.reset();
+                    }
 
-            return std::chrono::minutes{0};;
-        }
+                    // Serialize with other operations on the same hard link group. The members that
+                    // have not been updated yet still reference the original physical path, so that
+                    // is what the lock key is derived from.
+                    std::string lock_key;
+                    std::optional<locking::scoped_lock> lock;
+
+                    // Sized before the group lock is taken (see admission::fanout).
+                    const auto chunk_size = std::max<std::uintmax_t>(config.fanout_chunk_size, 1);
+                    admission::fanout fanout{plan
+                        ? plan->members.size()
+                        : static_cast<std::uintmax_t>(util::count_hard_link_members(conn, hl.uuid, hl.resource_id, chunk_size + 1))};
+
+                    if (plan) {
+                        lock_key = locking::make_lock_key(src_resource_id, plan->physical_path);
+                        lock.emplace(locking::group_locks(), lock_key);
+
+                        // The plan was made before a possibly long transfer, which runs without the
+                        // lock. If the group changed in the meantime, read it again instead.
+                        if (bulk::get_member_ids(conn, hl) != plan->member_ids) {
+                            log::rule_engine::debug("Hard link group changed during physical move [UUID={}, resource_id={}]",
+                                                    hl.uuid, hl.resource_id);
+                            plan.reset();
+                        }
+                    }
+                    else {
+                        for (auto&& path : util::hard_link_member_range{conn, hl.uuid, hl.resource_id, 2}) {
+                            if (path == input->objPath) {
+                                continue;
+                            }
 
-        auto get_minimum_replica_count(const ix::key_value_proxy<keyValPair_t>& _kvp) -> std::size_t
-        {
-            if (const auto iter = _kvp.find(COPIES_KW); iter != std::end(_kvp)) {
-                try {
-                    if (const auto value = std::stoull((*iter).value().data()); value > 0) {
-                        return value;
+                            if (const auto info = util::find_replica(conn, path, src_resource_id); info) {
+                                lock_key = locking::make_lock_key(src_resource_id, info->physical_path);
+                                lock.emplace(locking::group_locks(), lock_key);
+                            }
+
+                            break;
+                        }
                     }
+
+                    journal::entry entry{"move", lock_key, {
+                        {"uuid", hl.uuid},
+                        {"src_resource_id", src_resource_id},
+                        {"dst_resource_id", dst_resource_id},
+                        {"dst_resource_name", dst_resource_name},
+                        {"physical_path", new_physical_path}
+                    }};
+
+                    // Update the hard link information for each data object in the hard link group. The
+                    // plan made before the data was copied saves reading the group again.
+                    const auto member_count = plan
+                        ? bulk::apply_move_plan(conn, fanout, *plan, input->objPath, dst_resource_id, dst_resource_name, new_physical_path)
+                        : bulk::move_hard_link_members(conn, fanout, hl, dst_resource_id, dst_resource_name, new_physical_path);
+
+                    usage::record_group_moved(conn, src_resource_id, dst_resource_id, std::stoll(new_replica->data_size), member_count);
+
+                    events::batch changes;
+                    auto e = events::make_event({hl.uuid, dst_resource_id});
+                    e["previous_resource_id"] = src_resource_id;
+                    e["physical_path"] = new_physical_path;
+                    e["member_count"] = member_count;
+                    changes.add("group_repointed", std::move(e));
+                    changes.publish();
+
+                    entry.commit();
                 }
-                catch (...) {}
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
             }
 
-            return DEF_MIN_COPY_CNT;
+            return CODE(RULE_ENGINE_CONTINUE);
         }
 
-        auto get_replica_list(rsComm_t& _conn, dataObjInp_t& _input) -> std::vector<irods::physical_object>
+        auto make_hard_link(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
         {
-            ix::key_value_proxy kvp{_input.condInput};
-
-            if (!kvp.contains(RESC_HIER_STR_KW)) {
-                auto result = irods::resolve_resource_hierarchy(irods::UNLINK_OPERATION, &_conn, _input);
-                auto file_obj = std::get<irods::file_object_ptr>(result);
-                return file_obj->replicas();
-            }
+            try {
+                auto args_iter = std::begin(rule_arguments);
+                const auto& logical_path = *boost::any_cast<std::string*>(*args_iter);
+                const auto& replica_number = *boost::any_cast<std::string*>(*++args_iter);
+                const auto& link_name = *boost::any_cast<std::string*>(*++args_iter);
 
-            irods::file_object_ptr file_obj{new irods::file_object{}};
-            irods::error fac_err = irods::file_object_factory(&_conn, &_input, file_obj);
+                // Optional when invoked via the native rule language.
+                const std::string if_exists = rule_arguments.size() > 3 ? *boost::any_cast<std::string*>(*++args_iter) : "error";
 
-            if (!fac_err.ok()) {
-                THROW(fac_err.code(), "file_object_factory failed");
-            }
+                if (if_exists != "error" && if_exists != "verify") {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, fmt::format("Invalid value for if_exists [if_exists={}]", if_exists));
+                }
 
-            return file_obj->replicas();
-        }
+                // The other handlers ignore data objects outside of the configured collections.
+                if (!scope::contains(logical_path) || !scope::contains(link_name)) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "Hard links cannot be created outside of the configured collections");
+                }
 
-        auto get_list_of_replicas_to_trim(dataObjInp_t& _input, const std::vector<irods::physical_object>& _replicas)
-            -> std::vector<irods::physical_object>
-        {
-            std::vector<irods::physical_object> trim_list;
+                auto& conn = *util::get_rei(effect_handler).rsComm;
 
-            const auto good_replica_count = std::count_if(std::begin(_replicas), std::end(_replicas), [](const auto& repl) {
-                return (repl.replica_status() & 0x0F) == GOOD_REPLICA;
-            });
+                // Reruns of a workflow may request a link that already exists. When asked to, accept
+                // the request if the existing link is exactly the one that would be created.
+                if (if_exists == "verify" && util::is_existing_hard_link(conn, logical_path, replica_number, link_name)) {
+                    log::rule_engine::debug("Hard link already exists [logical_path={}, replica_number={}, link_name={}]",
+                                            logical_path, replica_number, link_name);
+                    return SUCCESS();
+                }
 
-            ix::key_value_proxy kvp{_input.condInput};
-            const auto minimum_replica_count = get_minimum_replica_count(kvp);
+                // Verify that the link name is not already in use.
+                if (const auto s = fs::server::status(conn, link_name); fs::server::exists(s)) {
+                    if (fs::server::is_collection(s)) {
+                        return ERROR(CAT_NAME_EXISTS_AS_COLLECTION, "The specified link name already exists");
+                    }
 
-            using clock_type = std::chrono::system_clock;
+                    if (fs::server::is_data_object(s)) {
+                        return ERROR(CAT_NAME_EXISTS_AS_DATAOBJ, "The specified link name already exists");
+                    }
 
-            const auto replica_meets_age_requirement =
-                [min_age = util::get_minimum_age_in_minutes(kvp), now = clock_type::now()](std::string_view _timestamp_in_secs)
-                {
-                    const clock_type::time_point last_modified{std::chrono::seconds{std::atoi(_timestamp_in_secs.data())}};
-                    return now - last_modified >= min_age;
-                };
+                    return ERROR(CAT_INVALID_ARGUMENT, "The specified link name already exists");
+                }
 
-            // If a specific replica number is specified, only trim that one!
-            if (const auto iter = kvp.find(REPL_NUM_KW); iter != std::end(kvp)) {
-                try {
-                    const auto end = std::end(_replicas);
-                    const auto repl = std::find_if(std::begin(_replicas), end,
-                        [n = std::stoi((*iter).value().data())](const auto& _r) {
-                            return n == _r.repl_num();
-                        });
+                // Get the data object information for the requested replicas.
+                const auto replicas = [&conn, &logical_path, &replica_number] {
+                    auto info = util::get_replicas(conn, logical_path);
 
-                    if (repl == end) {
-                        THROW(SYS_REPLICA_DOES_NOT_EXIST, "Target replica does not exist");
+                    if (info.empty()) {
+                        THROW(SYS_INTERNAL_ERR, "Could not gather data object information");
                     }
 
-                    if (!replica_meets_age_requirement(repl->modify_ts())) {
-                        THROW(USER_INCOMPATIBLE_PARAMS, "Target replica is not old enough for removal");
-                    }
+                    const auto replica_numbers = util::parse_replica_numbers(replica_number);
 
-                    if (good_replica_count <= minimum_replica_count && (repl->replica_status() & 0x0F) == GOOD_REPLICA) {
-                        THROW(USER_INCOMPATIBLE_PARAMS, "Cannot remove the last good replica");
+                    if (!replica_numbers) {
+                        return info;
                     }
 
-                    trim_list.push_back(*repl);
+                    std::vector<data_object_info> requested;
 
-                    return trim_list;
-                }
-                catch (const std::invalid_argument& e) {
-                    log::rule_engine::error(e.what());
-                    THROW(USER_INVALID_REPLICA_INPUT, "Invalid replica number requested");
-                }
-                catch (const std::out_of_range& e) {
-                    log::rule_engine::error(e.what());
-                    THROW(USER_INVALID_REPLICA_INPUT, "Invalid replica number requested");
-                }
-            }
+                    for (auto&& rn : *replica_numbers) {
+                        const auto iter = std::find_if(std::begin(info), std::end(info), [&rn](const auto& e) {
+                            return e.replica_number == rn;
+                        });
 
-            const auto resc_name = kvp.contains(RESC_NAME_KW) ? kvp[RESC_NAME_KW].value() : "";
-            const auto matches_target_resource = [&resc_name](const irods::physical_object& _obj) {
-                return irods::hierarchy_parser{_obj.resc_hier()}.first_resc() == resc_name;
-            };
+                        if (iter == std::end(info)) {
+                            THROW(USER_INVALID_REPLICA_INPUT, fmt::format("Replica does not exist [replica_number={}]", rn));
+                        }
 
-            // Walk list and add stale replicas to the list.
-            for (const auto& obj : _replicas) {
-                if ((obj.replica_status() & 0x0F) == STALE_REPLICA) {
-                    if (!replica_meets_age_requirement(obj.modify_ts()) || (!resc_name.empty() && !matches_target_resource(obj))) {
-                        continue;
+                        if (std::none_of(std::begin(requested), std::end(requested), [&rn](const auto& e) { return e.replica_number == rn; })) {
+                            requested.push_back(*iter);
+                        }
                     }
 
-                    trim_list.push_back(obj);
+                    return requested;
+                }();
+
+                // Prevent concurrent requests against the same physical objects from creating
+                // multiple hard link groups for them.
+                std::vector<std::string> lock_keys;
+
+                for (auto&& info : replicas) {
+                    lock_keys.push_back(locking::make_lock_key(info.resource_id, info.physical_path));
                 }
-            }
 
-            if (good_replica_count <= minimum_replica_count) {
-                return trim_list;
-            }
+                locking::scoped_multi_lock lock{locking::group_locks(), lock_keys};
 
-            // If we have not reached the minimum count, walk list again and add good replicas.
-            std::size_t good_replicas_to_be_trimmed = 0;
+                const auto hl_info = util::get_hard_links(conn, logical_path);
 
-            for (const auto& obj : _replicas) {
-                if ((obj.replica_status() & 0x0F) == GOOD_REPLICA) {
-                    if (!replica_meets_age_requirement(obj.modify_ts()) || (!resc_name.empty() && !matches_target_resource(obj))) {
-                        continue;
+                // The intent of every replica registered so far. Used to undo the link if a later
+                // step fails, so that no partially created link is left behind.
+                std::vector<std::pair<json, data_object_info>> linked;
+
+                // One record per replica. The records are committed once the link is complete.
+                std::deque<journal::entry> entries;
+
+                const auto unlink_all = [&conn, &linked, &entries] {
+                    for (auto iter = std::rbegin(linked); iter != std::rend(linked); ++iter) {
+                        journal::recover_create(conn, iter->first, {});
                     }
 
-                    if (good_replica_count - good_replicas_to_be_trimmed <= minimum_replica_count) {
-                        return trim_list;
+                    for (auto&& entry : entries) {
+                        entry.commit();
                     }
+                };
 
-                    trim_list.push_back(obj);
-                    ++good_replicas_to_be_trimmed;
-                }
-            }
+                // The groups of the link, and the groups the source joins by becoming hard linked.
+                std::vector<hard_link> link_groups;
+                std::vector<hard_link> new_groups;
 
-            return trim_list;
-        }
+                for (std::size_t i = 0; i < replicas.size(); ++i) {
+                    const auto& info = replicas[i];
+                    bool already_hard_linked = false;
+                    std::string uuid;
 
-        auto update_collection_mtime(rsComm_t& _conn,
-                                     const fs::path& _path1,
-                                     const std::optional<fs::path> _path2 = std::nullopt) -> void
-        {
-            try {
-                // Update the mtime of the source and destination collections if the paths reference
-                // collections in the local zone.
+                    // Check if the replica is already hard linked.
+                    if (const auto object = util::find_hard_link(hl_info, info.resource_id); object) {
+                        already_hard_linked = true;
+                        uuid = object->uuid;
+                        log::rule_engine::debug("Replica already hard linked [replica_number={}, UUID={}, resource_id={}]",
+                                                info.replica_number, uuid, info.resource_id);
+                    }
+                    else {
+                        uuid = util::generate_new_uuid(conn, info.resource_id);
+                        log::rule_engine::debug("Generated new hard link [UUID={}, resource_id={}]", uuid, info.resource_id);
+                    }
 
-                using std::chrono::system_clock;
-                using std::chrono::time_point_cast;
+                    json intent{
+                        {"source", logical_path},
+                        {"link_name", link_name},
+                        {"resource_id", info.resource_id},
+                        {"physical_path", info.physical_path},
+                        {"uuid", uuid},
+                        {"new_group", !already_hard_linked}
+                    };
 
-                const auto now = time_point_cast<fs::object_time_type::duration>(system_clock::now());
+                    auto& entry = entries.emplace_back("create", lock_keys[i], intent);
 
-                ix::scoped_privileged_client spc{_conn};
+                    // Register the replica with a new logical path. Every replica after the first is
+                    // added to the data object registered for the first.
+                    const auto ec = linked.empty()
+                        ? util::register_replica(conn, info, link_name, uuid)
+                        : util::register_additional_replica(conn, info, link_name, uuid);
 
-                const auto* local_zone = getLocalZoneName();
+                    if (ec < 0) {
+                        log::rule_engine::error("Could not make hard link [error_code={}, physical_path={}, link_name={}]",
+                                                ec, info.physical_path, link_name);
+                        unlink_all();
+                        return ERROR(ec, "Could not register physical path as a data object");
+                    }
 
-                if (const auto zone = fs::zone_name(_path1); zone && *zone == local_zone) {
-                    if (fs::server::is_collection_registered(_conn, _path1)) {
-                        fs::server::last_write_time(_conn, _path1, now);
+                    entry.step("registered");
+
+                    link_groups.push_back({uuid, info.resource_id});
+
+                    if (!already_hard_linked) {
+                        new_groups.push_back({uuid, info.resource_id});
                     }
+
+                    linked.emplace_back(std::move(intent), info);
                 }
 
-                if (_path2 && _path1 != *_path2) {
-                    if (const auto zone = fs::zone_name(*_path2); zone && *zone == local_zone) {
-                        if (fs::server::is_collection_registered(_conn, *_path2)) {
-                            fs::server::last_write_time(_conn, *_path2, now);
-                        }
+                // The metadata of each data object and the ACL of the link are each written in a
+                // single catalog transaction, regardless of the number of replicas.
+                try {
+                    util::add_hard_link_metadata(conn, link_name, link_groups);
+                    util::add_hard_link_metadata(conn, logical_path, new_groups);
+
+                    for (auto&& entry : entries) {
+                        entry.step("linked");
                     }
+
+                    util::copy_permissions(conn, logical_path, link_name);
                 }
-            }
-            catch (const fs::filesystem_error& e) {
-                if (_path2) {
-                    rodsLog(LOG_ERROR, "Could not update mtime of one or more collections. [path_1=%s, path_2=%s]",
-                            _path1.c_str(), _path2->c_str());
+                catch (const irods::exception& e) {
+                    util::log_exception(e);
+                    unlink_all();
+                    return e;
                 }
-                else {
-                    rodsLog(LOG_ERROR, "Could not update mtime of one or more collections. [path=%s]", _path1.c_str());
+                catch (const fs::filesystem_error& e) {
+                    log::rule_engine::error("{} [error_code={}]", e.what(), e.code().value());
+                    unlink_all();
+                    return ERROR(e.code().value(), e.what());
                 }
-            }
-        }
-    } // namespace util
 
-    //
-    // PEP Handlers
-    //
+                usage::batch counters;
+                events::batch changes;
 
-    namespace handler
-    {
-        auto pep_api_data_obj_rename_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
-        {
-            try {
-                auto* input = util::get_input_object_ptr<dataObjCopyInp_t>(rule_arguments);
-                auto& conn = *util::get_rei(effect_handler).rsComm;
-                const fs::path src_path = input->srcDataObjInp.objPath;
+                for (auto&& [intent, info] : linked) {
+                    // The hard link is owned by the client that registered it.
+                    auto link_info = info;
+                    link_info.owner_name = conn.clientUser.userName;
+                    link_info.owner_zone = conn.clientUser.rodsZone;
 
-                // If the path is part of a hard link group, then update the logical path and
-                // skip the actual rename operation. Else, do nothing and continue to the next REP.
-                if (!util::get_hard_links(conn, src_path).empty()) {
-                    const fs::path dst_path = input->destDataObjInp.objPath;
+                    const hard_link hl{intent.at("uuid").get<std::string>(), info.resource_id};
+                    const auto new_group = intent.at("new_group").get<bool>();
+                    usage::record_link_created(conn, counters, hl, info, link_info, new_group);
 
-                    // Do nothing if the paths are identical.
-                    if (src_path == dst_path) {
-                        return CODE(RULE_ENGINE_SKIP_OPERATION);
+                    if (new_group) {
+                        auto e = events::make_event(hl);
+                        e["logical_path"] = logical_path;
+                        e["physical_path"] = info.physical_path;
+                        changes.add("group_created", std::move(e));
                     }
 
-                    if (const auto ec = util::set_logical_path(conn, src_path, dst_path); ec < 0) {
-                        const auto msg = fmt::format("Could not update logical path. Use iadmin modrepl to update the "
-                                                     "data object. [from={}, to={}]",
-                                                     src_path.c_str(),
-                                                     dst_path.c_str());
-                        log::rule_engine::error(msg);
-                        addRErrorMsg(&util::get_rei(effect_handler).rsComm->rError, ec, msg.data());
-                    }
+                    auto e = events::make_event(hl);
+                    e["logical_path"] = link_name;
+                    e["physical_path"] = info.physical_path;
+                    changes.add("member_added", std::move(e));
+                }
 
-                    util::update_collection_mtime(conn, src_path.parent_path(), fs::path{input->destDataObjInp.objPath}.parent_path());
+                counters.flush(conn, "link_created");
 
-                    return CODE(RULE_ENGINE_SKIP_OPERATION);
+                // Published before the records are committed, so a crash in between cannot lose
+                // the events of a completed operation.
+                changes.publish();
+
+                for (auto&& entry : entries) {
+                    entry.commit();
                 }
             }
             catch (const irods::exception& e) {
@@ -637,86 +5035,155 @@ namespace
                 return ERROR(SYS_INTERNAL_ERR, e.what());
             }
 
-            return CODE(RULE_ENGINE_CONTINUE);
+            return SUCCESS();
         }
 
-        auto pep_api_data_obj_unlink_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        auto make_snapshot(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
         {
             try {
-                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+                auto args_iter = std::begin(rule_arguments);
+                const fs::path src_collection = *boost::any_cast<std::string*>(*args_iter);
+                const fs::path dst_collection = *boost::any_cast<std::string*>(*++args_iter);
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
+
                 auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                // Determine which sibling hard link members needs to have their hard link metadata
-                // updated to reflect the fact that the specified data object will be deleted. Some
-                // replicas may be deleted while others remain because they are being referenced by
-                // other data objects.
+                if (!fs::server::is_collection(conn, src_collection)) {
+                    return ERROR(NOT_A_COLLECTION, fmt::format("Source path is not a collection [path={}]", src_collection.c_str()));
+                }
+
+                if (!scope::paths().contains_tree(src_collection.c_str()) || !scope::paths().contains_tree(dst_collection.c_str())) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "Hard links cannot be created outside of the configured collections");
+                }
+
+                if (const auto& dst = dst_collection.string(); dst.compare(0, src_collection.string().size() + 1, src_collection.string() + '/') == 0) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "The destination collection cannot be inside of the source collection");
+                }
+
+                // The destination carries a marker until the snapshot is complete. A destination that
+                // carries the marker of the same source is an interrupted snapshot, which is resumed.
+                const fs::metadata marker{bulk::snapshot_attribute, src_collection.c_str(), "in_progress"};
+                const bool resume = fs::server::exists(conn, dst_collection);
+
+                if (resume) {
+                    const auto gql = fmt::format("select META_COLL_ATTR_VALUE "
+                                                 "where"
+                                                 " COLL_NAME = '{}' and"
+                                                 " META_COLL_ATTR_NAME = '{}' and"
+                                                 " META_COLL_ATTR_UNITS = '{}'",
+                                                 dst_collection.c_str(), marker.attribute, marker.units);
+
+                    bool is_marked = false;
+
+                    for (auto&& row : trace::query{&conn, gql}) {
+                        is_marked = is_marked || row[0] == marker.value;
+                    }
+
+                    if (!is_marked) {
+                        return ERROR(CAT_NAME_EXISTS_AS_COLLECTION, "The specified destination collection already exists");
+                    }
+
+                    log::rule_engine::info("Resuming interrupted snapshot [source_collection={}, destination_collection={}]",
+                                           src_collection.c_str(), dst_collection.c_str());
+                }
+                else {
+                    fs::server::create_collection(conn, dst_collection);
+                    trace::add_metadata(conn, dst_collection, marker);
+                }
+
+                const auto to_destination_path = [&src_collection, &dst_collection](const std::string& p) {
+                    return fs::path{dst_collection.string() + p.substr(src_collection.string().size())};
+                };
+
+                const auto tree_condition = util::make_collection_tree_condition(src_collection);
 
-                const auto hl_info = util::get_hard_links(conn, input->objPath);
+                // Data objects that could not be linked: sources without a good replica, and (when
+                // resuming) destination data objects that do not reference the source's replica.
+                std::vector<std::string> skipped;
 
-                if (hl_info.empty()) {
-                    return CODE(RULE_ENGINE_CONTINUE);
+                // Step 1: List every data object in the tree.
+                auto entries = bulk::list_data_objects(conn, src_collection, tree_condition, skipped);
+
+                // Step 2: Assign group ids. Replicas that are already hard linked keep their group.
+                bulk::assign_group_ids(conn, tree_condition, entries);
+
+                // Step 3: Mirror the collection tree. Parents sort before their children.
+                std::set<std::string> collections;
+
+                for (auto&& row : trace::query{&conn, fmt::format("select COLL_NAME where {}", tree_condition)}) {
+                    if (util::is_in_collection_tree(src_collection, row[0])) {
+                        collections.insert(to_destination_path(row[0]).string());
+                    }
                 }
 
-                // At this point, the data object to delete could be a member of multiple hard link groups.
-                // We must now partition the set of replicas into ones that will be deleted and ones that
-                // will be unregistered.
+                for (auto&& c : collections) {
+                    if (c != dst_collection.string() && (!resume || !fs::server::exists(conn, c))) {
+                        fs::server::create_collection(conn, c);
+                    }
+                }
 
-                for (auto&& replica : util::get_replicas(conn, input->objPath)) {
-                    log::rule_engine::debug("Handling replica [resource_id={}, replica_number={}, physical_path={}]",
-                                            replica.resource_id, replica.replica_number, replica.physical_path);
+                // Links made before the snapshot was interrupted.
+                const auto existing = resume ? bulk::list_destination_objects(conn, dst_collection)
+                                             : std::map<std::string, bulk::destination_object>{};
 
-                    // If the replica is hard linked, then unregister the replica and remove the hard link
-                    // metadata from the data object that is being deleted.
-                    if (const auto object = util::find_hard_link(hl_info, replica.resource_id); object) {
-                        const hard_link& info = object.value();
+                // Step 4: Register the hard links. Events are published a page at a time.
+                usage::batch usage_batch;
+                events::batch changes;
+                admission::fanout fanout;
+                std::size_t linked = 0;
 
-                        log::rule_engine::debug("Replica is hard linked. Unregistering replica ... "
-                                                "[replica_number={}, physical_path={}, UUID={}, resource_id={}]",
-                                                replica.replica_number, replica.physical_path, info.uuid, info.resource_id);
+                for (auto&& [path, e] : entries) {
+                    fanout.admit();
 
-                        if (const auto ec = util::unregister_replica(conn, input->objPath, replica.replica_number); ec < 0) {
-                            log::rule_engine::error("Could not remove hard link [{}]", input->objPath);
-                            return ERROR(ec, "Hard Link removal error");
-                        }
+                    if (changes.size() >= config.member_page_size) {
+                        changes.publish();
+                    }
 
-                        try {
-                            const auto md = util::make_hard_link_avu(info.uuid, info.resource_id);
+                    const auto link_name = to_destination_path(path);
+                    bool registered = false;
 
-                            if (fs::server::exists(conn, input->objPath)) {
-                                fs::server::remove_metadata(conn, input->objPath, md);
-                            }
+                    if (const auto iter = existing.find(link_name.string()); iter != std::end(existing)) {
+                        const auto& replicas = iter->second.replicas;
+                        registered = std::any_of(std::begin(replicas), std::end(replicas), [&e = e](const auto& r) {
+                            return r.first == e.replica.resource_id && r.second == e.replica.physical_path;
+                        });
 
-                            if (const auto members = util::get_hard_link_members(conn, info.uuid, info.resource_id);
-                                members.size() == 1)
-                            {
-                                fs::server::remove_metadata(conn, members[0], md);
-                            }
+                        if (!registered) {
+                            log::rule_engine::warn("Skipping data object that does not reference the source [path={}]", link_name.c_str());
+                            skipped.push_back(link_name.string());
+                            continue;
                         }
-                        catch (const fs::filesystem_error& e) {
-                            log::rule_engine::error("Could not remove hard link metadata "
-                                                    "[error_code={}, error_message={}, data_object={}, replica_number={}, UUID={}, resource_id={}]",
-                                                    e.code().value(), e.what(), input->objPath, replica.replica_number, info.uuid, info.resource_id);
-                            // TODO Should this be a hard stop?
-                            return ERROR(e.code().value(), e.what());
+
+                        // The link was completed before the interruption.
+                        if (iter->second.linked_resource_ids.count(e.replica.resource_id) > 0) {
+                            ++linked;
+                            continue;
                         }
                     }
-                    // If the replica is not hard linked, then simply unlink it.
-                    else {
-                        log::rule_engine::debug("Replica is NOT hard linked. Deleting replica ... [replica_number={}, physical_path={}]",
-                                                replica.replica_number, replica.physical_path);
 
-                        if (const auto ec = util::unlink_replica(conn, input->objPath, replica.replica_number); ec < 0) {
-                            log::rule_engine::error("Could not unlink replica [error_code={}, data_object={}, replica_number={}]",
-                                                    ec, input->objPath, replica.replica_number);
-                            return ERROR(ec, fmt::format("Could not unlink replica [data_object={}, replica_number={}",
-                                                         input->objPath, replica.replica_number));
-                        }
+                    if (const auto ec = bulk::link(conn, path, e, link_name, usage_batch, changes, registered); ec < 0) {
+                        usage_batch.flush(conn);
+                        changes.publish();
+                        return ERROR(ec, fmt::format("Could not register physical path as a data object [link_name={}]", link_name.c_str()));
                     }
+
+                    ++linked;
                 }
 
-                util::update_collection_mtime(conn, fs::path{input->objPath}.parent_path());
+                usage_batch.flush(conn);
+                changes.publish();
 
-                return CODE(RULE_ENGINE_SKIP_OPERATION);
+                // Step 5: Update the mtime of each new collection once.
+                bulk::update_collection_mtimes(conn, collections);
+                util::update_collection_mtime(conn, dst_collection.parent_path());
+
+                trace::remove_metadata(conn, dst_collection, marker);
+
+                output = json{{"data_objects", linked}, {"collections", collections.size()}, {"skipped", skipped}}.dump();
+            }
+            catch (const fs::filesystem_error& e) {
+                log::rule_engine::error("{} [error_code={}]", e.what(), e.code().value());
+                return ERROR(e.code().value(), e.what());
             }
             catch (const irods::exception& e) {
                 util::log_exception(e);
@@ -726,135 +5193,208 @@ namespace
                 return ERROR(SYS_INTERNAL_ERR, e.what());
             }
 
-            return CODE(RULE_ENGINE_CONTINUE);
+            return SUCCESS();
         }
 
-        auto pep_api_data_obj_trim_pre(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        auto sync(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
         {
             try {
-                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+                auto args_iter = std::begin(rule_arguments);
+                const fs::path src_collection = *boost::any_cast<std::string*>(*args_iter);
+                const fs::path dst_collection = *boost::any_cast<std::string*>(*++args_iter);
+                const auto& watermark = *boost::any_cast<std::string*>(*++args_iter);
+                const auto remove_orphans = (*boost::any_cast<std::string*>(*++args_iter) == "true");
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
+
                 auto& conn = *util::get_rei(effect_handler).rsComm;
-                const auto hl_info = util::get_hard_links(conn, input->objPath);
-                
-                if (hl_info.empty()) {
-                    log::rule_engine::debug("Data object is not part of a hard link group [data_object={}].", input->objPath);
-                    return CODE(RULE_ENGINE_CONTINUE);
-                }
 
-                ix::key_value_proxy kvp{input->condInput};
+                if (!fs::server::is_collection(conn, src_collection)) {
+                    return ERROR(NOT_A_COLLECTION, fmt::format("Source path is not a collection [path={}]", src_collection.c_str()));
+                }
 
-                // TODO Add deprecation message for itrim -N (4-2-stable only)!
+                if (!scope::paths().contains_tree(src_collection.c_str()) || !scope::paths().contains_tree(dst_collection.c_str())) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "Hard links cannot be created outside of the configured collections");
+                }
 
-                if (kvp.contains(RESC_NAME_KW) && // -S
-                    kvp.contains(REPL_NUM_KW))    // -n
-                {
-                    return ERROR(USER_INCOMPATIBLE_PARAMS, "Incompatible parameters: source resource name and replica number");
+                if (const auto& dst = dst_collection.string(); dst.compare(0, src_collection.string().size() + 1, src_collection.string() + '/') == 0) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "The destination collection cannot be inside of the source collection");
                 }
 
-                specCollCache_t* specCollCache = nullptr;
-                resolveLinkedPath(&conn, input->objPath, &specCollCache, &input->condInput);
+                std::int64_t since = 0;
 
-                rodsServerHost_t* rodsServerHost = nullptr;
-                
-                if (const auto ec = getAndConnRemoteZone(&conn, input, &rodsServerHost, REMOTE_OPEN); ec < 0) {
-                    return ERROR(ec, "Redirect error");
+                try {
+                    since = std::stoll(watermark);
                 }
-                else if (ec == REMOTE_HOST) {
-                    const auto ec = rcDataObjTrim(rodsServerHost->conn, input);
-                    
-                    if (ec < 0) {
-                        return ERROR(ec, "Redirect error");
+                catch (...) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, fmt::format("Invalid watermark [watermark={}]", watermark));
+                }
+
+                const auto to_destination_path = [&src_collection, &dst_collection](const std::string& p) {
+                    return fs::path{dst_collection.string() + p.substr(src_collection.string().size())};
+                };
+
+                // Captured before querying so that changes made while the sync is running are picked
+                // up by the next sync. Changes within the watermark's second may be seen twice, which
+                // is harmless because up-to-date links are left alone.
+                const auto new_watermark = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+
+                // The catalog stores timestamps as zero-padded strings of eleven digits.
+                const auto changes_condition = fmt::format("DATA_MODIFY_TIME >= '{:011}' and {}",
+                                                           since, util::make_collection_tree_condition(src_collection));
+
+                // Source data objects without a good replica, and data objects in the destination tree
+                // that are not hard links. The latter are never removed, because doing so would delete
+                // their data.
+                std::vector<std::string> skipped;
+
+                auto entries = bulk::list_data_objects(conn, src_collection, changes_condition, skipped);
+                bulk::assign_group_ids(conn, changes_condition, entries);
+
+                std::size_t linked = 0;
+                std::size_t relinked = 0;
+                std::size_t updated = 0;
+                std::set<std::string> modified_collections;
+                usage::batch usage_batch;
+
+                // Events are published a page at a time.
+                events::batch changes;
+
+                const auto flush_and_return = [&](int ec, const fs::path& p) {
+                    usage_batch.flush(conn);
+                    changes.publish();
+                    bulk::update_collection_mtimes(conn, modified_collections);
+                    return ERROR(ec, fmt::format("Could not synchronize hard link [path={}]", p.c_str()));
+                };
+
+                admission::fanout fanout;
+
+                for (auto&& [path, e] : entries) {
+                    fanout.admit();
+
+                    if (changes.size() >= config.member_page_size) {
+                        changes.publish();
                     }
 
-                    return CODE(ec);
-                }
+                    const auto link_name = to_destination_path(path);
+                    const auto replicas = util::get_replicas(conn, link_name);
 
-                int error_code = 0;
-                std::string replica_number;
+                    if (!replicas.empty()) {
+                        const auto end = std::end(replicas);
+                        const auto iter = std::find_if(std::begin(replicas), end, [&e = e](const auto& r) {
+                            return r.resource_id == e.replica.resource_id && r.physical_path == e.replica.physical_path;
+                        });
 
-                // Temporarily remove REPL_NUM_KW to ensure we are returned all replicas in the list.
-                if (kvp.contains(REPL_NUM_KW)) {
-                    replica_number = kvp[REPL_NUM_KW].value().data();
-                    kvp.erase(REPL_NUM_KW);
-                }
+                        // The link already references the same physical object. The data may have been
+                        // overwritten in place though, so bring the size up to date.
+                        if (iter != end) {
+                            if (iter->data_size != e.replica.data_size) {
+                                if (const auto ec = util::set_data_size(conn, link_name, iter->replica_number, e.replica.data_size, e.uuid); ec < 0) {
+                                    return flush_and_return(ec, link_name);
+                                }
 
-                const auto repl_list = util::get_replica_list(conn, *input);
+                                ++updated;
+                            }
 
-                if (!replica_number.empty()) {
-                    kvp[REPL_NUM_KW] = replica_number;
-                }
+                            continue;
+                        }
 
-                const auto is_dry_run = kvp.contains(DRYRUN_KW);
+                        // The source now references a different physical object. Remove the stale link
+                        // so that it can be recreated, unless the data object was not created as a link.
+                        if (!bulk::is_hard_linked(conn, link_name, replicas)) {
+                            log::rule_engine::warn("Skipping data object that is not a hard link [path={}]", link_name.c_str());
+                            skipped.push_back(link_name.string());
+                            continue;
+                        }
 
-                for (auto&& obj : util::get_list_of_replicas_to_trim(*input, repl_list)) {
-                    log::rule_engine::debug("Replica to trim [data_object={}, replica_number={}, physical_path={}]",
-                                            input->objPath, obj.repl_num(), obj.path());
+                        if (const auto ec = bulk::remove(conn, link_name); ec < 0) {
+                            return flush_and_return(ec, link_name);
+                        }
 
-                    if (is_dry_run) {
-                        log::rule_engine::debug("This is a dry run. Skipping ...");
-                        error_code = 1;
-                        continue;
+                        ++relinked;
                     }
+                    else {
+                        if (const auto parent = link_name.parent_path(); !fs::server::exists(conn, parent)) {
+                            fs::server::create_collections(conn, parent);
+                        }
 
-                    log::rule_engine::debug("Checking if replica is hard linked ...");
+                        ++linked;
+                    }
 
-                    if (const auto object = util::find_hard_link(hl_info, std::to_string(obj.resc_id())); object) {
-                        const hard_link& hl = object.value();
+                    if (const auto ec = bulk::link(conn, path, e, link_name, usage_batch, changes); ec < 0) {
+                        return flush_and_return(ec, link_name);
+                    }
 
-                        log::rule_engine::debug("Unregistering replica. [UUID={}, resource_id={}]", hl.uuid, hl.resource_id);
+                    modified_collections.insert(link_name.parent_path().string());
+                }
 
-                        if (const auto ec = util::unregister_replica(conn, input->objPath, std::to_string(obj.repl_num())); ec < 0) {
-                            log::rule_engine::error("Could not unregister replica [data_object={}, replica_number={}]",
-                                                    input->objPath, obj.repl_num());
-                            return ERROR(ec, "Could not unregister replica");
+                usage_batch.flush(conn);
+                changes.publish();
+
+                // Deleted data objects leave no trace in the catalog, so finding orphaned links requires
+                // listing both trees. Only logical paths are fetched.
+                std::size_t removed = 0;
+
+                if (remove_orphans) {
+                    std::set<std::string> sources;
+
+                    for (auto&& row : trace::query{&conn, fmt::format("select COLL_NAME, DATA_NAME where {}",
+                                                                      util::make_collection_tree_condition(src_collection))})
+                    {
+                        if (!util::is_in_collection_tree(src_collection, row[0])) {
+                            continue;
                         }
 
-                        try {
-                            const auto md = util::make_hard_link_avu(hl.uuid, hl.resource_id);
+                        sources.insert(to_destination_path(util::make_logical_path(row[0], row[1])).string());
+                    }
 
-                            // Because trimming a data object never deletes it, we must always remove any hard link
-                            // metadata associated with it.
-                            fs::server::remove_metadata(conn, input->objPath, md);
+                    std::set<std::string> orphans;
 
-                            // Remove any hard link metadata that represents a hard link group of size one.
-                            // Hard links groups always have at least two data objects in them.
-                            if (const auto members = util::get_hard_link_members(conn, hl.uuid, hl.resource_id);
-                                members.size() == 1)
-                            {
-                                fs::server::remove_metadata(conn, members[0], md);
-                            }
+                    for (auto&& row : trace::query{&conn, fmt::format("select COLL_NAME, DATA_NAME where {}",
+                                                                      util::make_collection_tree_condition(dst_collection))})
+                    {
+                        if (!util::is_in_collection_tree(dst_collection, row[0])) {
+                            continue;
                         }
-                        catch (const fs::filesystem_error& e) {
-                            log::rule_engine::error("Could not remove hard link metadata "
-                                                    "[error_code={}, error_message={}, data_object={}, replica_number={}, UUID={}, resource_id={}]",
-                                                    e.code().value(), e.what(), input->objPath, obj.repl_num(), hl.uuid, hl.resource_id);
-                            return ERROR(e.code().value(), e.what());
+
+                        if (auto p = util::make_logical_path(row[0], row[1]); sources.count(p) == 0) {
+                            orphans.insert(std::move(p));
                         }
                     }
-                    else {
-                        log::rule_engine::debug("Unlinking replica ...");
 
-                        auto dobj_info = util::convert_physical_object_to_dataObjInfo_t(obj);
-
-                        // The replica is not part of a hard link group, so delete it.
-                        // The else-block is not making sense to me. It is basically saying that if the first
-                        // replica is successfully deleted, remember that success code and do not allow any failures
-                        // to be returned back to the client.
-                        if (const auto ec = dataObjUnlinkS(&conn, input, &dobj_info); ec < 0) {
-                            log::rule_engine::error("Could not unlink replica [error_code={}, data_object={}, replica_number={}]",
-                                                    ec, input->objPath, dobj_info.replNum);
+                    for (auto&& p : orphans) {
+                        fanout.admit();
 
-                            if (error_code == 0) {
-                                error_code = ec;
-                            }
+                        if (!bulk::is_hard_linked(conn, p, util::get_replicas(conn, p))) {
+                            log::rule_engine::warn("Skipping data object that is not a hard link [path={}]", p);
+                            skipped.push_back(p);
+                            continue;
                         }
-                        else {
-                            error_code = 1;
+
+                        if (const auto ec = bulk::remove(conn, p); ec < 0) {
+                            bulk::update_collection_mtimes(conn, modified_collections);
+                            return ERROR(ec, fmt::format("Could not remove orphaned hard link [path={}]", p));
                         }
+
+                        modified_collections.insert(fs::path{p}.parent_path().string());
+                        ++removed;
                     }
                 }
 
-                return CODE(RULE_ENGINE_SKIP_OPERATION);
+                bulk::update_collection_mtimes(conn, modified_collections);
+
+                output = json{
+                    {"watermark", std::to_string(new_watermark)},
+                    {"linked", linked},
+                    {"relinked", relinked},
+                    {"updated", updated},
+                    {"removed", removed},
+                    {"skipped", skipped}
+                }.dump();
+            }
+            catch (const fs::filesystem_error& e) {
+                log::rule_engine::error("{} [error_code={}]", e.what(), e.code().value());
+                return ERROR(e.code().value(), e.what());
             }
             catch (const irods::exception& e) {
                 util::log_exception(e);
@@ -864,98 +5404,250 @@ namespace
                 return ERROR(SYS_INTERNAL_ERR, e.what());
             }
 
-            return CODE(RULE_ENGINE_CONTINUE);
+            return SUCCESS();
         }
 
-        auto pep_api_data_obj_phymv_post(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        auto get_storage_usage(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
         {
             try {
-                auto* input = util::get_input_object_ptr<dataObjInp_t>(rule_arguments);
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
                 auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                if (!fs::server::is_data_object(conn, input->objPath)) {
-                    return CODE(RULE_ENGINE_CONTINUE);
+                output = usage::to_json(conn).dump();
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
+
+            return SUCCESS();
+        }
+
+        auto rebuild_storage_usage(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
+                auto& conn = *util::get_rei(effect_handler).rsComm;
+
+                if (!irods::is_privileged_client(conn)) {
+                    return ERROR(CAT_INSUFFICIENT_PRIVILEGE_LEVEL, "Rebuilding hard link storage usage requires administrative privileges");
                 }
 
-                const auto hl_info = util::get_hard_links(conn, input->objPath);
+                usage::rebuild(conn);
 
-                ix::key_value_proxy kvp{input->condInput};
+                output = usage::to_json(conn).dump();
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
 
-                auto src_resc = util::resolve_resource(kvp.at(RESC_NAME_KW).value());
-                rodsLong_t src_resc_id;
-                src_resc->get_property(irods::RESOURCE_ID, src_resc_id);
-                log::rule_engine::debug("Source resource id = {}", src_resc_id);
+            return SUCCESS();
+        }
 
-                auto dst_resc = util::resolve_resource(kvp.at(DEST_RESC_NAME_KW).value());
-                rodsLong_t dst_resc_id;
-                dst_resc->get_property(irods::RESOURCE_ID, dst_resc_id);
-                log::rule_engine::debug("Destination resource id = {}", dst_resc_id);
+        auto migrate_resource(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto args_iter = std::begin(rule_arguments);
+                const auto& src_resource_name = *boost::any_cast<std::string*>(*args_iter);
+                const auto& dst_resource_name = *boost::any_cast<std::string*>(*++args_iter);
+                const auto shard_index = std::stoul(*boost::any_cast<std::string*>(*++args_iter));
+                const auto shard_count = std::stoul(*boost::any_cast<std::string*>(*++args_iter));
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
 
-                std::string dst_resource_name;
-                dst_resc->get_property(irods::RESOURCE_NAME, dst_resource_name);
-                log::rule_engine::debug("Destination resource name = {}", dst_resource_name);
+                auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                const auto src_resource_id = std::to_string(src_resc_id);
+                if (!irods::is_privileged_client(conn)) {
+                    return ERROR(CAT_INSUFFICIENT_PRIVILEGE_LEVEL, "Migrating a resource requires administrative privileges");
+                }
 
-                if (auto object = util::find_hard_link(hl_info, src_resource_id); object) {
-                    const hard_link& hl = object.value();
+                if (shard_count == 0 || shard_index >= shard_count) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "The shard count must be at least 1 and the shard index less than the shard count");
+                }
+
+                rodsLong_t id;
+
+                util::resolve_resource(src_resource_name)->get_property(irods::RESOURCE_ID, id);
+                const auto src_resource_id = std::to_string(id);
+
+                util::resolve_resource(dst_resource_name)->get_property(irods::RESOURCE_ID, id);
+                const auto dst_resource_id = std::to_string(id);
+
+                if (src_resource_id == dst_resource_id) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "The source and destination resources must be different");
+                }
+
+                std::int64_t groups = 0;
+                std::int64_t members = 0;
+                std::int64_t failed = 0;
+                std::string last_uuid;
+
+                // The counters, events and journal records of a page of groups are written together.
+                usage::batch counters;
+                events::batch changes;
+                std::deque<journal::entry> entries;
+
+                // Groups are fetched a page at a time in UUID order. A migrated group no longer
+                // references the source resource, so running the operation again after an
+                // interruption only visits the groups that remain.
+                while (true) {
+                    const auto gql = fmt::format("select order(META_DATA_ATTR_VALUE) "
+                                                 "where"
+                                                 " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                                 " META_DATA_ATTR_UNITS = '{}' and"
+                                                 " META_DATA_ATTR_VALUE > '{}'",
+                                                 src_resource_id, last_uuid);
+
+                    std::vector<std::string> uuids;
+
+                    for (auto&& row : trace::query{&conn, gql, config.member_page_size}) {
+                        uuids.push_back(std::move(row[0]));
+                    }
+
+                    for (auto&& uuid : uuids) {
+                        if (!migration::is_in_shard(uuid, shard_index, shard_count)) {
+                            continue;
+                        }
+
+                        try {
+                            members += migration::migrate_group(conn, {uuid, src_resource_id}, src_resource_name, dst_resource_id,
+                                                                dst_resource_name, counters, changes, entries);
+                            ++groups;
+                        }
+                        catch (const irods::exception& e) {
+                            log::rule_engine::error("Could not migrate hard link group [UUID={}, error_code={}, error_message={}]",
+                                                    uuid, e.code(), e.what());
+                            ++failed;
+                        }
+                    }
+
+                    // Published before the records are committed, so a crash in between cannot lose
+                    // the events of a migrated group.
+                    counters.flush(conn, "group_moved");
+                    changes.publish();
+
+                    for (auto&& entry : entries) {
+                        entry.commit();
+                    }
+
+                    entries.clear();
+
+                    if (uuids.size() < std::max<std::uintmax_t>(config.member_page_size, 1)) {
+                        break;
+                    }
+
+                    last_uuid = uuids.back();
+                }
+
+                output = json{{"groups", groups}, {"members", members}, {"failed", failed}}.dump();
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
 
-                    log::rule_engine::debug("Found hard link information [UUID={}, resource_id={}]", hl.uuid, hl.resource_id);
+            return SUCCESS();
+        }
 
-                    // Retrieve the physical path of the data object that was recently updated.
-                    const auto dst_resource_id = std::to_string(dst_resc_id);
-                    const auto new_physical_path = [&] {
-                        for (auto&& info : util::get_replicas(conn, input->objPath)) {
-                            if (info.resource_id == dst_resource_id) {
-                                return info.physical_path;
-                            }
-                        }
+        auto verify(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto args_iter = std::begin(rule_arguments);
+                const auto verify_checksum = (*boost::any_cast<std::string*>(*args_iter) == "true");
+                const auto shard_index = std::stoul(*boost::any_cast<std::string*>(*++args_iter));
+                const auto shard_count = std::stoul(*boost::any_cast<std::string*>(*++args_iter));
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
 
-                        THROW(SYS_INTERNAL_ERR, "Could not find replica information by resource id");
-                    }();
+                auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                    util::replace_hard_link_metadata(conn, input->objPath, hl, dst_resource_id);
+                if (!irods::is_privileged_client(conn)) {
+                    return ERROR(CAT_INSUFFICIENT_PRIVILEGE_LEVEL, "Verifying hard link groups requires administrative privileges");
+                }
 
-                    auto members = util::get_hard_link_members(conn, hl.uuid, hl.resource_id);
+                if (shard_count == 0 || shard_index >= shard_count) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM, "The shard count must be at least 1 and the shard index less than the shard count");
+                }
 
-                    {
-                        auto end = std::end(members);
-                        auto pred = [input](const auto& e) { return e == input->objPath; };
-                        members.erase(std::remove_if(std::begin(members), end, pred), end);
+                fixity::summary summary;
+                admission::fanout fanout;
+                std::optional<hard_link> last;
+                const auto page_size = std::max<std::uintmax_t>(config.member_page_size, 1);
+
+                // Groups are fetched a page at a time in (UUID, resource id) order. Each shard can be
+                // verified by a separate agent, and the fan-out slots bound the number of agents reading
+                // physical objects at the same time.
+                while (true) {
+                    std::vector<hard_link> groups;
+
+                    // GenQuery cannot compare both columns at once, so a page starts with the groups
+                    // sharing the last UUID seen (one per resource) and continues with later UUIDs.
+                    if (last) {
+                        const auto gql = fmt::format("select META_DATA_ATTR_VALUE, order(META_DATA_ATTR_UNITS) "
+                                                     "where"
+                                                     " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                                     " META_DATA_ATTR_VALUE = '{}' and"
+                                                     " META_DATA_ATTR_UNITS > '{}'",
+                                                     last->uuid, last->resource_id);
+
+                        for (auto&& row : trace::query{&conn, gql, page_size}) {
+                            groups.push_back({std::move(row[0]), std::move(row[1])});
+                        }
                     }
 
-                    // Update the hard link information for each data object in the hard link group.
-                    // It is possible that some data objects in the hard link group have multiple replicas.
-                    // In this case, we must find the replica that is part of the hard link group and
-                    // update it. This should only update a single replica's physical path.
-                    for (auto&& path : members) {
-                        util::replace_hard_link_metadata(conn, path, hl, dst_resource_id);
+                    if (groups.size() < page_size) {
+                        const auto gql = fmt::format("select order(META_DATA_ATTR_VALUE), order(META_DATA_ATTR_UNITS) "
+                                                     "where"
+                                                     " META_DATA_ATTR_NAME = 'irods::hard_link' and"
+                                                     " META_DATA_ATTR_VALUE > '{}'",
+                                                     last ? last->uuid : "");
 
-                        const auto replicas = util::get_replicas(conn, path);
-                        const auto end = std::end(replicas);
-                        const auto iter = std::find_if(std::begin(replicas), end, [&src_resource_id](const auto& r) {
-                            log::rule_engine::debug("Replica info [replica_number={}, resource_id={}, physical_path={}]",
-                                                    r.replica_number, r.resource_id, r.physical_path);
-                            return r.resource_id == src_resource_id;
-                        });
+                        for (auto&& row : trace::query{&conn, gql, page_size - groups.size()}) {
+                            groups.push_back({std::move(row[0]), std::move(row[1])});
+                        }
+                    }
 
-                        if (iter == end) {
-                            return ERROR(SYS_INTERNAL_ERR, "Could not find replica information by resource id");
+                    for (auto&& hl : groups) {
+                        if (!migration::is_in_shard(hl.uuid, shard_index, shard_count)) {
+                            continue;
                         }
 
-                        const auto ec = util::set_replica_info(conn,
-                                                               path,
-                                                               iter->replica_number,
-                                                               dst_resource_id,
-                                                               dst_resource_name,
-                                                               new_physical_path);
+                        fanout.admit();
 
-                        if (ec < 0) {
-                            log::rule_engine::error("Could not update the physical path [error_code={}, data_object={}, replica_number={}]",
-                                                    ec, path.c_str(), iter->replica_number);
+                        try {
+                            fixity::verify_group(conn, hl, verify_checksum, summary);
+                            ++summary.groups;
+                        }
+                        catch (const irods::exception& e) {
+                            log::rule_engine::error("Could not verify hard link group [UUID={}, resource_id={}, error_code={}, error_message={}]",
+                                                    hl.uuid, hl.resource_id, e.code(), e.what());
+                            ++summary.failed;
                         }
                     }
+
+                    if (groups.size() < page_size) {
+                        break;
+                    }
+
+                    last = groups.back();
                 }
+
+                output = json{
+                    {"groups", summary.groups},
+                    {"physical_objects", summary.physical_objects},
+                    {"members", summary.members},
+                    {"statuses", summary.statuses},
+                    {"failed", summary.failed},
+                    {"problems", summary.problems}
+                }.dump();
             }
             catch (const irods::exception& e) {
                 util::log_exception(e);
@@ -965,100 +5657,106 @@ namespace
                 return ERROR(SYS_INTERNAL_ERR, e.what());
             }
 
-            return CODE(RULE_ENGINE_CONTINUE);
+            return SUCCESS();
         }
 
-        auto make_hard_link(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        auto remove_group(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
         {
             try {
-                auto args_iter = std::begin(rule_arguments);
-                const auto& logical_path = *boost::any_cast<std::string*>(*args_iter);
-                const auto& replica_number = *boost::any_cast<std::string*>(*++args_iter);
-                const auto& link_name = *boost::any_cast<std::string*>(*++args_iter);
+                const auto& group = *boost::any_cast<std::string*>(rule_arguments.front());
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
 
                 auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                // Verify that the link name is not already in use.
-                if (const auto s = fs::server::status(conn, link_name); fs::server::exists(s)) {
-                    if (fs::server::is_collection(s)) {
-                        return ERROR(CAT_NAME_EXISTS_AS_COLLECTION, "The specified link name already exists");
+                if (!irods::is_privileged_client(conn)) {
+                    return ERROR(CAT_INSUFFICIENT_PRIVILEGE_LEVEL, "Removing a hard link group requires administrative privileges");
+                }
+
+                // The group is identified by its UUID or by the logical path of any member.
+                std::optional<hard_link> hl;
+                fs::path member;
+
+                if (!group.empty() && group.front() == '/') {
+                    const auto hl_info = util::get_hard_links(conn, group);
+
+                    if (hl_info.size() > 1) {
+                        return ERROR(SYS_INVALID_INPUT_PARAM, "The data object is a member of multiple hard link groups. Use the UUID of the group instead");
                     }
 
-                    if (fs::server::is_data_object(s)) {
-                        return ERROR(CAT_NAME_EXISTS_AS_DATAOBJ, "The specified link name already exists");
+                    if (!hl_info.empty()) {
+                        hl = hl_info.front();
+                        member = group;
                     }
+                }
+                else {
+                    const auto gql = fmt::format("select META_DATA_ATTR_UNITS, COLL_NAME, DATA_NAME "
+                                                 "where META_DATA_ATTR_NAME = 'irods::hard_link' and META_DATA_ATTR_VALUE = '{}'",
+                                                 group);
 
-                    return ERROR(CAT_INVALID_ARGUMENT, "The specified link name already exists");
+                    for (auto&& row : trace::query{&conn, gql, 1}) {
+                        hl = hard_link{group, row[0]};
+                        member = util::make_logical_path(row[1], row[2]);
+                    }
                 }
 
-                // Get the data object information for the requested replica.
-                const auto& info = [&conn, &logical_path, &replica_number] {
-                    const auto info = util::get_replicas(conn, logical_path);
+                if (!hl) {
+                    return ERROR(CAT_NO_ROWS_FOUND, fmt::format("Hard link group does not exist [group={}]", group));
+                }
 
-                    if (info.empty()) {
-                        THROW(SYS_INTERNAL_ERR, "Could not gather data object information");
-                    }
+                const auto replica = util::find_replica(conn, member, hl->resource_id);
 
-                    const auto end = std::end(info);
-                    const auto iter = std::find_if(std::begin(info), end, [&replica_number](const auto& e) {
-                        return e.replica_number == replica_number;
-                    });
+                if (!replica) {
+                    THROW(SYS_INTERNAL_ERR, fmt::format("Could not find replica information by resource id [data_object={}]", member.c_str()));
+                }
 
-                    if (iter != end) {
-                        return *iter;
-                    }
+                // Sized before the group lock is taken (see admission::fanout).
+                const auto chunk_size = std::max<std::uintmax_t>(config.fanout_chunk_size, 1);
+                admission::fanout fanout{static_cast<std::uintmax_t>(util::count_hard_link_members(conn, hl->uuid, hl->resource_id, chunk_size + 1))};
 
-                    THROW(USER_INVALID_REPLICA_INPUT, "Replica does not exist");
-                }();
+                const auto lock_key = locking::make_lock_key(hl->resource_id, replica->physical_path);
+                locking::scoped_lock lock{locking::group_locks(), lock_key};
 
-                // Register the replica with a new logical path.
-                if (const auto ec = util::register_replica(conn, info, link_name); ec < 0) {
-                    log::rule_engine::error("Could not make hard link [error_code={}, physical_path={}, link_name={}]",
-                                            ec, info.physical_path, link_name);
-                    return ERROR(ec, "Could not register physical path as a data object");
-                }
+                journal::entry entry{"remove_group", lock_key, {
+                    {"uuid", hl->uuid},
+                    {"resource_id", hl->resource_id},
+                    {"physical_path", replica->physical_path}
+                }};
 
-                bool already_hard_linked = false;
-                std::string uuid;
+                const auto result = bulk::remove_hard_link_group(conn, fanout, *hl, replica->physical_path);
 
-                // Check if the replica is already hard linked.
-                if (auto hl_info = util::get_hard_links(conn, logical_path); !hl_info.empty()) {
-                    if (const auto object = util::find_hard_link(hl_info, info.resource_id); object) {
-                        already_hard_linked = true;
-                        const hard_link& hl = object.value();
-                        uuid = std::move(hl.uuid);
-                        log::rule_engine::debug("Replica already hard linked [replica_number={}, UUID={}, resource_id={}]",
-                                                replica_number, uuid, hl.resource_id);
-                    }
-                }
+                events::batch changes;
+                auto e = events::make_event(*hl);
+                e["physical_path"] = replica->physical_path;
+                e["members_removed"] = result.removed;
+                changes.add("group_removed", std::move(e));
+                changes.publish();
 
-                if (!already_hard_linked) {
-                    uuid = util::generate_new_uuid(conn, info.resource_id);
-                    log::rule_engine::debug("Generated new hard link [UUID={}, resource_id={}]", uuid, info.resource_id);
-                }
+                entry.commit();
 
-                try {
-                    const auto md = util::make_hard_link_avu(uuid, info.resource_id);
+                output = json{{"members", result.removed}, {"failed", result.failed}}.dump();
+            }
+            catch (const irods::exception& e) {
+                util::log_exception(e);
+                return e;
+            }
+            catch (const std::exception& e) {
+                return ERROR(SYS_INTERNAL_ERR, e.what());
+            }
 
-                    // Set hard link metadata on the new data object (the hard linked data object).
-                    fs::server::add_metadata(conn, link_name, md);
+            return SUCCESS();
+        }
 
-                    // Set hard link metadata on the source data object if it the replica was not
-                    // already hard linked.
-                    if (!already_hard_linked) {
-                        fs::server::add_metadata(conn, logical_path, md);
-                    }
+        auto recover(std::list<boost::any>& rule_arguments, irods::callback& effect_handler) -> irods::error
+        {
+            try {
+                auto& output = *boost::any_cast<std::string*>(rule_arguments.back());
+                auto& conn = *util::get_rei(effect_handler).rsComm;
 
-                    // Copy permissions to the hard link.
-                    const auto status = fs::server::status(conn, logical_path);
-                    for (auto&& e : status.permissions()) {
-                        fs::server::permissions(conn, link_name, e.name, e.prms);
-                    }
-                }
-                catch (const fs::filesystem_error& e) {
-                    log::rule_engine::error("{} [error_code={}]", e.what(), e.code().value());
-                    return ERROR(e.code().value(), e.what());
+                if (!irods::is_privileged_client(conn)) {
+                    return ERROR(CAT_INSUFFICIENT_PRIVILEGE_LEVEL, "Recovering hard link operations requires administrative privileges");
                 }
+
+                output = journal::recover(conn).dump();
             }
             catch (const irods::exception& e) {
                 util::log_exception(e);
@@ -1081,23 +5779,173 @@ namespace
     using handler_map_type = std::map<std::string_view, handler_type>;
 
     const handler_map_type pep_handlers{
-        {"pep_api_data_obj_rename_pre",  handler::pep_api_data_obj_rename_pre},
-        {"pep_api_data_obj_unlink_pre",  handler::pep_api_data_obj_unlink_pre},
-        {"pep_api_data_obj_trim_pre",    handler::pep_api_data_obj_trim_pre},
-        {"pep_api_data_obj_phymv_post",  handler::pep_api_data_obj_phymv_post}
+        {"pep_api_data_obj_rename_pre",    handler::pep_api_data_obj_rename_pre},
+        {"pep_api_data_obj_unlink_pre",    handler::pep_api_data_obj_unlink_pre},
+        {"pep_api_data_obj_trim_pre",      handler::pep_api_data_obj_trim_pre},
+        {"pep_api_data_obj_phymv_pre",     handler::pep_api_data_obj_phymv_pre},
+        {"pep_api_data_obj_phymv_post",    handler::pep_api_data_obj_phymv_post},
+        {"pep_api_data_obj_phymv_finally", handler::pep_api_data_obj_phymv_finally}
     };
 
     // TODO Could expose these as a new .so. The .so would then be loaded by the new "irods" cli.
     // Then we get things like: irods ln <args>...
     const handler_map_type hard_link_handlers{
-        {"hard_link_create",  handler::make_hard_link},
-        {"hard_links_create", handler::make_hard_link}
+        {"hard_link_create",            handler::make_hard_link},
+        {"hard_links_create",           handler::make_hard_link},
+        {"hard_links_snapshot",         handler::make_snapshot},
+        {"hard_links_sync",             handler::sync},
+        {"hard_links_usage",            handler::get_storage_usage},
+        {"hard_links_usage_rebuild",    handler::rebuild_storage_usage},
+        {"hard_links_recover",          handler::recover},
+        {"hard_links_migrate_resource", handler::migrate_resource},
+        {"hard_links_remove_group",     handler::remove_group},
+        {"hard_links_verify",           handler::verify}
+    };
+
+    struct operation_parameter
+    {
+        const char* name;
+        const char* default_value = nullptr; // Required if null.
+    };
+
+    // The JSON properties passed (in order) as string arguments to each operation when invoked
+    // via exec_rule_text. Every operation also receives a trailing string argument that holds
+    // its output (if any).
+    const std::map<std::string_view, std::vector<operation_parameter>> operation_parameters{
+        {"hard_link_create",            {{"logical_path"}, {"replica_number"}, {"link_name"}, {"if_exists", "error"}}},
+        {"hard_links_create",           {{"logical_path"}, {"replica_number"}, {"link_name"}, {"if_exists", "error"}}},
+        {"hard_links_snapshot",         {{"source_collection"}, {"destination_collection"}}},
+        {"hard_links_sync",             {{"source_collection"}, {"destination_collection"}, {"watermark", "0"}, {"remove_orphans", "false"}}},
+        {"hard_links_usage",            {}},
+        {"hard_links_usage_rebuild",    {}},
+        {"hard_links_recover",          {}},
+        {"hard_links_migrate_resource", {{"source_resource"}, {"destination_resource"}, {"shard_index", "0"}, {"shard_count", "1"}}},
+        {"hard_links_remove_group",     {{"group"}}},
+        {"hard_links_verify",           {{"verify_checksum", "false"}, {"shard_index", "0"}, {"shard_count", "1"}}}
     };
     // clang-format on
 
+    // The operations that do not return anything. All other operations write their output to
+    // the trailing string argument.
+    const std::set<std::string_view> operations_without_output{"hard_link_create", "hard_links_create"};
+
+    // Native rule language callers pass arguments positionally, so the handlers cannot trust the
+    // length of the argument list. Operations that return output require every parameter plus the
+    // output argument. The others require at least their required parameters.
+    auto has_valid_argument_count(std::string_view _op, const std::list<boost::any>& _args) -> bool
+    {
+        const auto& parameters = operation_parameters.at(_op);
+
+        if (operations_without_output.count(_op) == 0) {
+            return _args.size() == parameters.size() + 1;
+        }
+
+        const auto required = std::count_if(std::begin(parameters), std::end(parameters), [](auto&& _p) {
+            return !_p.default_value;
+        });
+
+        return _args.size() >= static_cast<std::size_t>(required) && _args.size() <= parameters.size() + 1;
+    }
+
     template <typename ...Args>
     using operation = std::function<irods::error(irods::default_re_ctx&, Args...)>;
 
+    auto start(irods::default_re_ctx&, const std::string& instance_name) -> irods::error
+    {
+        try {
+            const auto& rule_engines = irods::get_server_property<const json&>(
+                std::vector<std::string>{irods::KW_CFG_PLUGIN_CONFIGURATION, irods::KW_CFG_PLUGIN_TYPE_RULE_ENGINE});
+
+            for (auto&& re : rule_engines) {
+                if (re.at(irods::KW_CFG_INSTANCE_NAME).get_ref<const std::string&>() != instance_name) {
+                    continue;
+                }
+
+                const auto iter = re.find(irods::KW_CFG_PLUGIN_SPECIFIC_CONFIGURATION);
+
+                if (iter == std::end(re)) {
+                    break;
+                }
+
+                const auto& plugin_config = *iter;
+
+                if (const auto v = plugin_config.find("lock_directory"); v != std::end(plugin_config)) {
+                    config.lock_directory = v->get<std::string>();
+                }
+
+                if (const auto v = plugin_config.find("lock_stripe_count"); v != std::end(plugin_config)) {
+                    config.lock_stripe_count = v->get<std::size_t>();
+                }
+
+                if (const auto v = plugin_config.find("member_page_size"); v != std::end(plugin_config)) {
+                    config.member_page_size = v->get<std::uintmax_t>();
+                }
+
+                if (const auto v = plugin_config.find("journal_directory"); v != std::end(plugin_config)) {
+                    config.journal_directory = v->get<std::string>();
+                }
+
+                if (const auto v = plugin_config.find("fanout_chunk_size"); v != std::end(plugin_config)) {
+                    config.fanout_chunk_size = v->get<std::uintmax_t>();
+                }
+
+                if (const auto v = plugin_config.find("fanout_slots"); v != std::end(plugin_config)) {
+                    config.fanout_slots = v->get<std::size_t>();
+                }
+
+                if (const auto v = plugin_config.find("fanout_rate_limit"); v != std::end(plugin_config)) {
+                    config.fanout_rate_limit = v->get<std::uintmax_t>();
+                }
+
+                if (const auto v = plugin_config.find("trace_directory"); v != std::end(plugin_config)) {
+                    config.trace_directory = v->get<std::string>();
+                }
+
+                if (const auto v = plugin_config.find("include_collections"); v != std::end(plugin_config)) {
+                    config.include_collections = v->get<std::vector<std::string>>();
+                }
+
+                if (const auto v = plugin_config.find("exclude_collections"); v != std::end(plugin_config)) {
+                    config.exclude_collections = v->get<std::vector<std::string>>();
+                }
+
+                if (const auto v = plugin_config.find("event_log_directory"); v != std::end(plugin_config)) {
+                    config.event_log_directory = v->get<std::string>();
+                }
+
+                if (const auto v = plugin_config.find("event_log_segment_size"); v != std::end(plugin_config)) {
+                    config.event_log_segment_size = v->get<std::uintmax_t>();
+                }
+
+                break;
+            }
+
+            // Compiled once so that the handlers can test paths without allocating.
+            auto& trie = scope::paths();
+            trie = {};
+
+            for (auto&& c : config.include_collections) {
+                trie.insert(c, true);
+            }
+
+            for (auto&& c : config.exclude_collections) {
+                trie.insert(c, false);
+            }
+
+            trie.finalize();
+        }
+        catch (const irods::exception& e) {
+            util::log_exception(e);
+            return e;
+        }
+        catch (const std::exception& e) {
+            log::rule_engine::error("Could not load plugin configuration [error_message={}]", e.what());
+            return ERROR(SYS_CONFIG_FILE_ERR, e.what());
+        }
+
+        return SUCCESS();
+    }
+
     auto rule_exists(irods::default_re_ctx&, const std::string& rule_name, bool& exists) -> irods::error
     {
         exists = (pep_handlers.find(rule_name) != std::end(pep_handlers) ||
@@ -1121,18 +5969,34 @@ namespace
         return SUCCESS();
     }
 
-    auto exec_rule(irods::default_re_ctx&,
-                   const std::string& rule_name,
-                   std::list<boost::any>& rule_arguments,
-                   irods::callback effect_handler) -> irods::error
+    // Calls the handler between the "handler__entry" and "handler__return" probes.
+    auto invoke_handler(const handler_map_type::value_type& handler,
+                        std::list<boost::any>& rule_arguments,
+                        irods::callback& effect_handler) -> irods::error
+    {
+        HARD_LINKS_PROBE(handler__entry, handler.first.data());
+        auto result = handler.second(rule_arguments, effect_handler);
+        HARD_LINKS_PROBE(handler__return, handler.first.data(), result.code());
+        return result;
+    }
+
+    auto exec_rule_impl(const std::string& rule_name,
+                        std::list<boost::any>& rule_arguments,
+                        irods::callback& effect_handler) -> irods::error
     {
         try {
             if (auto iter = pep_handlers.find(rule_name); std::end(pep_handlers) != iter) {
-                return (iter->second)(rule_arguments, effect_handler);
+                return invoke_handler(*iter, rule_arguments, effect_handler);
             }
 
             if (auto iter = hard_link_handlers.find(rule_name); std::end(hard_link_handlers) != iter) {
-                return (iter->second)(rule_arguments, effect_handler);
+                if (!has_valid_argument_count(iter->first, rule_arguments)) {
+                    return ERROR(SYS_INVALID_INPUT_PARAM,
+                                 fmt::format("Incorrect number of arguments [operation={}, argument_count={}]",
+                                             rule_name, rule_arguments.size()));
+                }
+
+                return invoke_handler(*iter, rule_arguments, effect_handler);
             }
         }
         catch (...) {
@@ -1145,38 +6009,228 @@ namespace
         return CODE(RULE_ENGINE_CONTINUE);
     }
 
-    auto exec_rule_text_impl(std::string_view rule_text, irods::callback effect_handler) -> irods::error
+    auto exec_rule(irods::default_re_ctx&,
+                   const std::string& rule_name,
+                   std::list<boost::any>& rule_arguments,
+                   irods::callback effect_handler) -> irods::error
+    {
+        HARD_LINKS_PROBE(exec_rule__entry, rule_name.c_str());
+        auto result = exec_rule_impl(rule_name, rule_arguments, effect_handler);
+        HARD_LINKS_PROBE(exec_rule__return, rule_name.c_str(), result.code());
+        return result;
+    }
+
+    // Appends text to the stdout buffer of the "ruleExecOut" parameter so that it is returned
+    // to the client (e.g. irule).
+    auto write_to_rule_exec_out(msParamArray_t* ms_params, std::string_view text) -> void
+    {
+        if (!ms_params || text.empty()) {
+            return;
+        }
+
+        auto* msp = getMsParamByLabel(ms_params, "ruleExecOut");
+
+        if (!msp) {
+            auto* out = static_cast<execCmdOut_t*>(std::calloc(1, sizeof(execCmdOut_t)));
+            addMsParamToArray(ms_params, "ruleExecOut", ExecCmdOut_MS_T, out, nullptr, 0);
+            msp = getMsParamByLabel(ms_params, "ruleExecOut");
+        }
+
+        if (auto* out = static_cast<execCmdOut_t*>(msp->inOutStruct); out) {
+            appendToByteBuf(&out->stdoutBuf, const_cast<char*>(std::string{text}.append("\n").c_str()));
+        }
+    }
+
+    // Formatting log arguments (e.g. dumping JSON) is not free, so callers check this first.
+    auto is_debug_logging_enabled() noexcept -> bool
+    {
+        return log::rule_engine::get_level() <= log::level::debug;
+    }
+
+    // Returns the operation text embedded in the rule text, without copying it.
+    //
+    //   irule <text>:        @external rule { <operation> }
+    //   irule -F <script>:   @external\n<operation> }
+    auto unwrap_rule_text(std::string_view rule_text) noexcept -> std::string_view
+    {
+        constexpr std::string_view external = "@external";
+
+        const auto pos = rule_text.find(external);
+
+        if (pos == std::string_view::npos) {
+            return rule_text;
+        }
+
+        auto body = rule_text.substr(pos + external.size());
+
+        if (const auto start = body.find_first_not_of(" \t\r\n"); start != std::string_view::npos) {
+            body.remove_prefix(start);
+        }
+
+        // The braces of a rule block are not part of the operation. Without a rule block, the
+        // operation (JSON or a prefixed payload) follows "@external" directly.
+        if (body.substr(0, 4) == "rule") {
+            if (const auto brace = body.find('{'); brace != std::string_view::npos) {
+                body.remove_prefix(brace + 1);
+            }
+        }
+
+        return body.substr(0, body.rfind(" }"));
+    }
+
+    // Decodes standard base64. Whitespace is ignored. Padding is optional but may only appear at
+    // the end, and lengths no encoder produces (e.g. a single trailing character) are rejected.
+    auto decode_base64(std::string_view text) -> std::optional<std::vector<std::uint8_t>>
+    {
+        const auto decode_char = [](char c) -> int {
+            if (c >= 'A' && c <= 'Z') { return c - 'A'; }
+            if (c >= 'a' && c <= 'z') { return c - 'a' + 26; }
+            if (c >= '0' && c <= '9') { return c - '0' + 52; }
+            if (c == '+') { return 62; }
+            if (c == '/') { return 63; }
+            return -1;
+        };
+
+        std::vector<std::uint8_t> bytes;
+        bytes.reserve(text.size() / 4 * 3);
+
+        std::uint32_t buffer = 0;
+        int bits = 0;
+        std::size_t characters = 0;
+        std::size_t padding = 0;
+
+        for (auto c : text) {
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                continue;
+            }
+
+            if (c == '=') {
+                ++padding;
+                continue;
+            }
+
+            const auto v = decode_char(c);
+
+            // Data after padding is not base64.
+            if (v < 0 || padding > 0) {
+                return std::nullopt;
+            }
+
+            buffer = (buffer << 6) | static_cast<std::uint32_t>(v);
+            bits += 6;
+            ++characters;
+
+            if (bits >= 8) {
+                bits -= 8;
+                bytes.push_back(static_cast<std::uint8_t>(buffer >> bits));
+            }
+        }
+
+        const auto remainder = characters % 4;
+
+        // One character cannot hold a byte, and padding must complete the last group exactly.
+        if (remainder == 1 || (padding > 0 && (remainder == 0 || remainder + padding != 4))) {
+            return std::nullopt;
+        }
+
+        // The bits left over after the last byte must be zero, otherwise the text was truncated
+        // or altered.
+        if ((buffer & ((1u << bits) - 1)) != 0) {
+            return std::nullopt;
+        }
+
+        return bytes;
+    }
+
+    // Parses the operation. Besides JSON, machine clients may send the same object encoded as
+    // MessagePack or CBOR. Rule text cannot hold arbitrary bytes, so the encoding is named by a
+    // prefix and the payload is base64 encoded (e.g. "msgpack:gqlvcGVyYXRpb24...").
+    auto parse_operation(std::string_view text) -> json
     {
-        log::rule_engine::debug("rule text = {}", rule_text);
+        constexpr std::string_view msgpack_prefix = "msgpack:";
+        constexpr std::string_view cbor_prefix = "cbor:";
+
+        const auto decode = [](std::string_view payload) {
+            if (auto bytes = decode_base64(payload); bytes) {
+                return std::move(*bytes);
+            }
+
+            THROW(USER_INPUT_FORMAT_ERR, "Invalid base64 payload");
+        };
+
+        if (const auto start = text.find_first_not_of(" \t\r\n"); start != std::string_view::npos) {
+            text.remove_prefix(start);
+        }
+
+        if (text.substr(0, msgpack_prefix.size()) == msgpack_prefix) {
+            return json::from_msgpack(decode(text.substr(msgpack_prefix.size())));
+        }
 
-        // irule <text>
-        if (rule_text.find("@external rule {") != std::string::npos) {
-            const auto start = rule_text.find_first_of('{') + 1;
-            rule_text = rule_text.substr(start, rule_text.rfind(" }") - start);
+        if (text.substr(0, cbor_prefix.size()) == cbor_prefix) {
+            return json::from_cbor(decode(text.substr(cbor_prefix.size())));
         }
-        // irule -F <script>
-        else if (rule_text.find("@external") != std::string::npos) {
-            const auto start = rule_text.find_first_of('{');
-            rule_text = rule_text.substr(start, rule_text.rfind(" }") - start);
+
+        return json::parse(std::begin(text), std::end(text));
+    }
+
+    auto exec_rule_text_impl(std::string_view rule_text, msParamArray_t* ms_params, irods::callback effect_handler) -> irods::error
+    {
+        const auto debug = is_debug_logging_enabled();
+
+        if (debug) {
+            log::rule_engine::debug("rule text = {}", rule_text);
         }
 
-        log::rule_engine::debug("rule text = {}", std::string{rule_text});
+        rule_text = unwrap_rule_text(rule_text);
 
         try {
-            const auto json_args = json::parse(rule_text);
+            auto json_args = parse_operation(rule_text);
 
-            log::rule_engine::debug("json input = {}", json_args.dump());
+            if (debug) {
+                log::rule_engine::debug("json input = {}", json_args.dump());
+            }
 
-            const auto op = json_args.at("operation").get<std::string>();
+            const auto& op = json_args.at("operation").get_ref<const std::string&>();
 
             if (const auto iter = hard_link_handlers.find(op); iter != std::end(hard_link_handlers)) {
-                auto logical_path = json_args.at("logical_path").get<std::string>();
-                auto replica_number = json_args.at("replica_number").get<std::string>();
-                auto link_name = json_args.at("link_name").get<std::string>();
+                const auto& parameters = operation_parameters.at(iter->first);
+
+                // Holds the arguments that are not strings in the input. The handlers receive
+                // pointers to these strings, so the vector must never reallocate.
+                std::vector<std::string> values;
+                values.reserve(parameters.size() + 1);
+
+                std::list<boost::any> args;
+
+                for (auto&& [name, default_value] : parameters) {
+                    if (const auto v = json_args.find(name); v != std::end(json_args)) {
+                        // String values are passed without copying them. Non-string values (e.g.
+                        // numbers and booleans) are passed in their JSON form.
+                        if (v->is_string()) {
+                            args.push_back(&v->get_ref<std::string&>());
+                        }
+                        else {
+                            args.push_back(&values.emplace_back(v->dump()));
+                        }
+                    }
+                    else if (default_value) {
+                        args.push_back(&values.emplace_back(default_value));
+                    }
+                    else {
+                        return ERROR(USER_INPUT_FORMAT_ERR, fmt::format("Missing required property [property={}]", name));
+                    }
+                }
 
-                std::list<boost::any> args{&logical_path, &replica_number, &link_name};
+                auto& output = values.emplace_back();
+                args.push_back(&output);
 
-                return (iter->second)(args, effect_handler);
+                const auto result = invoke_handler(*iter, args, effect_handler);
+
+                if (result.ok()) {
+                    write_to_rule_exec_out(ms_params, output);
+                }
+
+                return result;
             }
 
             return ERROR(INVALID_OPERATION, fmt::format("Invalid operation [operation={}]", op));
@@ -1185,6 +6239,10 @@ namespace
             log::rule_engine::error(e.what());
             return ERROR(USER_INPUT_FORMAT_ERR, e.what());
         }
+        catch (const irods::exception& e) {
+            util::log_exception(e);
+            return e;
+        }
         catch (const std::exception& e) {
             log::rule_engine::error(e.what());
             return ERROR(SYS_INTERNAL_ERR, e.what());
@@ -1210,11 +6268,11 @@ auto plugin_factory(const std::string& _instance_name,
 
     const auto exec_rule_text_wrapper = [](irods::default_re_ctx&,
                                            const std::string& rule_text,
-                                           msParamArray_t*,
+                                           msParamArray_t* ms_params,
                                            const std::string&,
                                            irods::callback effect_handler)
     {
-        return exec_rule_text_impl(rule_text, effect_handler);
+        return exec_rule_text_impl(rule_text, ms_params, effect_handler);
     };
 
     const auto exec_rule_expression_wrapper = [](irods::default_re_ctx&,
@@ -1222,12 +6280,12 @@ auto plugin_factory(const std::string& _instance_name,
                                                  msParamArray_t* ms_params,
                                                  irods::callback effect_handler)
     {
-        return exec_rule_text_impl(rule_text, effect_handler);
+        return exec_rule_text_impl(rule_text, ms_params, effect_handler);
     };
 
     auto* re = new pluggable_rule_engine{_instance_name, _context};
 
-    re->add_operation("start", operation<const std::string&>{no_op});
+    re->add_operation("start", operation<const std::string&>{start});
     re->add_operation("stop", operation<const std::string&>{no_op});
     re->add_operation("rule_exists", operation<const std::string&, bool&>{rule_exists});
     re->add_operation("list_rules", operation<std::vector<std::string>&>{list_rules});